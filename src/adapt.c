@@ -0,0 +1,154 @@
+/* adapt.c
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+#include "const.h"
+#include "adapt.h"
+
+
+/*
+ * Initialize the model with only the NYT leaf.
+ */
+void adapt_init(adapt_model *m) {
+    for (int i = 0; i < ADAPT_SYMBOLS; i++) {
+        m->leaf[i] = -1;
+    }
+    m->nyt = ADAPT_NODES - 1;
+    adapt_node *root = &m->nodes[m->nyt];
+    root->weight = 0;
+    root->parent = root->zero = root->one = -1;
+    root->symb = ADAPT_NYT;
+}
+
+/* Link again the children or the symbol of the node i after it moved */
+void _adapt_relink(adapt_model *m, int i) {
+    adapt_node *p = &m->nodes[i];
+    if (p->zero >= 0) {
+        m->nodes[p->zero].parent = i;
+        m->nodes[p->one].parent = i;
+    } else if (p->symb == ADAPT_NYT) {
+        m->nyt = i;
+    } else {
+        m->leaf[p->symb] = i;
+    }
+}
+
+/* Swap the subtrees of the nodes i and j, that keep their numbers */
+void _adapt_swap(adapt_model *m, int i, int j) {
+    adapt_node *a = &m->nodes[i], *b = &m->nodes[j], t = *a;
+    a->weight = b->weight; a->zero = b->zero; a->one = b->one; a->symb = b->symb;
+    b->weight = t.weight; b->zero = t.zero; b->one = t.one; b->symb = t.symb;
+    _adapt_relink(m, i);
+    _adapt_relink(m, j);
+}
+
+/* Add one occurrence of symb, adding its leaf if it's new */
+void _adapt_update(adapt_model *m, int symb) {
+    int q = m->leaf[symb];
+    if (q < 0) {
+        // The NYT leaf is split in the new NYT leaf and the leaf of the symbol
+        int old = m->nyt;
+        adapt_node *p = &m->nodes[old];
+        p->zero = old - 2;
+        p->one = old - 1;
+        for (int i = old - 2; i < old; i++) {
+            m->nodes[i].weight = 0;
+            m->nodes[i].parent = old;
+            m->nodes[i].zero = m->nodes[i].one = -1;
+        }
+        m->nodes[old - 2].symb = ADAPT_NYT;
+        m->nodes[old - 1].symb = symb;
+        m->nyt = old - 2;
+        m->leaf[symb] = q = old - 1;
+    }
+    while (q >= 0) {
+        // The node goes to the highest number with its weight, except its parent
+        int leader = q;
+        while (leader < ADAPT_NODES - 1 && m->nodes[leader + 1].weight == m->nodes[q].weight) {
+            leader++;
+        }
+        if (leader != q && leader != m->nodes[q].parent) {
+            _adapt_swap(m, q, leader);
+            q = leader;
+        }
+        m->nodes[q].weight++;
+        q = m->nodes[q].parent;
+    }
+}
+
+/* Write the code of the node i, from the root to the node */
+void _adapt_put_code(const adapt_model *m, int i, bitwriter *bw) {
+    unsigned char bits[ADAPT_NODES];
+    int n = 0;
+    for (int p = m->nodes[i].parent; p >= 0; i = p, p = m->nodes[p].parent) {
+        bits[n++] = m->nodes[p].one == i;
+    }
+    while (n > 0) {
+        // Up to 32 bits at once
+        uint64_t code = 0;
+        int len = n < 32 ? n : 32;
+        for (int k = 0; k < len; k++) {
+            code = (code << 1) | bits[--n];
+        }
+        bitwriter_put(bw, code, len);
+    }
+}
+
+/*
+ * Write the code of symb (a byte or ADAPT_END) into
+ * bw, and update the model.
+ */
+void adapt_encode(adapt_model *m, int symb, bitwriter *bw) {
+    if (m->leaf[symb] >= 0) {
+        _adapt_put_code(m, m->leaf[symb], bw);
+    } else {
+        _adapt_put_code(m, m->nyt, bw);
+        bitwriter_put(bw, symb, ADAPT_SYMB_NBITS);
+    }
+    _adapt_update(m, symb);
+}
+
+/*
+ * Read the next symbol from br into symb (a byte or ADAPT_END),
+ * and update the model.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int adapt_decode(adapt_model *m, bitreader *br, int *symb) {
+    int i = ADAPT_NODES - 1;
+    while (m->nodes[i].zero >= 0) {
+        if (!br->nbits) bitreader_refill(br);
+        i = bitreader_peek(br, 1) ? m->nodes[i].one : m->nodes[i].zero;
+        bitreader_skip(br, 1);
+    }
+    if (m->nodes[i].symb == ADAPT_NYT) {
+        if (br->nbits < ADAPT_SYMB_NBITS) bitreader_refill(br);
+        *symb = bitreader_peek(br, ADAPT_SYMB_NBITS);
+        bitreader_skip(br, ADAPT_SYMB_NBITS);
+        if (*symb >= ADAPT_SYMBOLS || m->leaf[*symb] >= 0) {
+            return INVALID_FILE_IN;
+        }
+    } else {
+        *symb = m->nodes[i].symb;
+    }
+    if (br->zeros * 8 > (size_t) br->nbits) {
+        return INVALID_FILE_IN;     // The end of the input was passed
+    }
+    _adapt_update(m, *symb);
+    return OK;
+}
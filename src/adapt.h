@@ -0,0 +1,82 @@
+/* adapt.h
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef __AH_ADAPT_H
+#define __AH_ADAPT_H
+
+
+#include <stdint.h>
+#include "bitio.h"
+
+
+#define ADAPT_END           256     /* Symbol encoded after the last one */
+#define ADAPT_SYMBOLS       257     /* The 256 bytes and ADAPT_END */
+#define ADAPT_SYMB_NBITS    9       /* Bits of a symbol sent the first time */
+#define ADAPT_NYT           -1      /* Symbol of the leaf "not yet transmitted" */
+#define ADAPT_NODES         (2 * (ADAPT_SYMBOLS + 1) - 1)
+
+
+/*
+ * Node of the adaptive Huffman tree. Each node is stored in the
+ * position given by its number: the nodes with higher weight
+ * have higher numbers, and the root is the last node.
+ */
+typedef struct _adapt_node {
+    uint64_t weight;            /* Occurrences of the symbols of the node */
+    int parent;                 /* Number of the parent node, or -1 */
+    int zero, one;              /* Numbers of the children, or -1 if leaf */
+    int symb;                   /* Symbol of the leaf, or ADAPT_NYT */
+} adapt_node;
+
+/*
+ * Adaptive Huffman model (FGK algorithm): the tree is updated
+ * after each symbol encoded or decoded, so the codes follow the
+ * frequencies of the symbols seen so far, and nothing has to be
+ * counted or stored before the codes. The first time a symbol is
+ * seen, the code of the NYT leaf is sent followed by the symbol
+ * with ADAPT_SYMB_NBITS bits, and then the leaf is split to add it.
+ */
+typedef struct _adapt_model {
+    adapt_node nodes[ADAPT_NODES];
+    int leaf[ADAPT_SYMBOLS];    /* Number of the leaf of each symbol, or -1 */
+    int nyt;                    /* Number of the NYT leaf */
+} adapt_model;
+
+
+/*
+ * Initialize the model with only the NYT leaf.
+ */
+void adapt_init(adapt_model *m);
+
+/*
+ * Write the code of symb (a byte or ADAPT_END) into
+ * bw, and update the model.
+ */
+void adapt_encode(adapt_model *m, int symb, bitwriter *bw);
+
+/*
+ * Read the next symbol from br into symb (a byte or ADAPT_END),
+ * and update the model.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int adapt_decode(adapt_model *m, bitreader *br, int *symb);
+
+
+#endif /* __AH_ADAPT_H */
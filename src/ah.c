@@ -18,18 +18,30 @@
    <http://www.gnu.org/licenses/>.  */
 
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "ah.h"
+#include "adapt.h"
+#include "aio.h"
+#include "block.h"
+#include "codec.h"
 #include "const.h"
 #include "freqlist.h"
+#include "hist.h"
+#include "ring.h"
+#include "spec.h"
 #include "util.h"
 
 
-#define VERSION_BYTE    HEADER_COO_VERSION << (8 - HEADER_COO_VERSION_BITS)
-#define FLAGS_1_BYTE    0
+#define FLAGS_1_BYTE    (HEADER_FLAG_BLOCKS | HEADER_FLAG_STORED)
+#define PIPELINE_DEPTH  2       /* Blocks of each encoder in the pipeline */
 
 
 /*
@@ -41,10 +53,23 @@ ah_data *ah_data_init(void) {
     if (data) {
         data->verbose = FALSE;
         data->decompres = FALSE;
+        data->threads = 1;
+        data->max_nbits = MAX_CODE_NBITS;
+        data->streams = 1;
+        data->context = FALSE;
+        data->adaptive = FALSE;
+        data->fast = FALSE;
+        data->index = FALSE;
+        data->range = FALSE;
+        data->range_offset = 0;
+        data->range_length = 0;
         data->filename_in = NULL;
         data->fi = NULL;
-        data->buffer_in = NULL;
-        data->length_buff = 0;
+        data->map = NULL;
+        data->map_len = 0;
+        data->map_pos = 0;
+        data->stream = FALSE;
+        data->counted = FALSE;
         data->freql = NULL;
         data->length_in = 0l;
         data->length_out = 0l;
@@ -55,6 +80,42 @@ ah_data *ah_data_init(void) {
 }
 
 
+/*
+ * Return the size of f if it's a regular file,
+ * or -1 if not (pipes, memory streams...).
+ */
+off_t _ah_regular_file_size(FILE *f) {
+    struct stat st;
+    int fd = fileno(f);
+    if (fd < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+        return -1;
+    }
+    return st.st_size;
+}
+
+/*
+ * Map the input file in memory, if it's a regular file, to read
+ * it without copying it. If it can't be mapped, data->map is NULL
+ * and the file is read with stdio.
+ */
+void _ah_map_input(ah_data *data) {
+    off_t size = _ah_regular_file_size(data->fi);
+    if (size <= 0 || (uint64_t) size > SIZE_MAX) {
+        return;
+    }
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(data->fi), 0);
+    if (map == MAP_FAILED) {
+        return;
+    }
+    // Only hints, nothing changes if they are not supported
+    madvise(map, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(map, size, MADV_HUGEPAGE);
+#endif
+    data->map = (const unsigned char *) map;
+    data->map_len = size;
+}
+
 /*
  * Initialization of input/output data structures
  * from the given file name.
@@ -83,18 +144,27 @@ int ah_data_init_resources(ah_data *data) {
                 return ERROR_FILE_OUT;
             }
         }
+        _ah_map_input(data);
     } else {
         data->fi = fdopen(dup(fileno(stdin)), "rb");
-        data->buffer_in = (unsigned char *)malloc(BUFFER_WINDOW);
-        if (!data->buffer_in) {
-            return ERROR_MEM;
-        }
-        data->length_buff = BUFFER_WINDOW;
+        data->stream = TRUE;
         data->fo = fdopen(dup(fileno(stdout)), "wb");
     }
-    // For now only the version of the format is stored in the flags byte
     data->header_flags[0] = VERSION_BYTE;
     data->header_flags[1] = FLAGS_1_BYTE;
+    if (data->context) {
+        data->streams = 1;              // The codes of the contexts are in one stream
+        data->header_flags[1] |= HEADER_FLAG_CONTEXT;
+    }
+    if (data->streams > 1) {
+        data->header_flags[1] |= HEADER_FLAG_STREAMS;
+    }
+    if (data->index) {
+        data->header_flags[1] |= HEADER_FLAG_INDEX;
+    }
+    if (data->adaptive) {
+        data->header_flags[1] = HEADER_FLAG_ADAPTIVE;
+    }
     return 0;
 }
 
@@ -112,6 +182,9 @@ freqlist *ah_data_init_freql(ah_data *data) {
  * Free all input/output resources of the application.
  */
 void ah_data_free_resources(ah_data *data) {
+    if (data->map) {
+        munmap((void *) data->map, data->map_len);
+    }
     if (data->fi) {
         fflush(data->fi);
         fclose(data->fi);
@@ -123,51 +196,68 @@ void ah_data_free_resources(ah_data *data) {
             free(data->filename_out);
         }
     }
-    if (data->buffer_in) {
-        free(data->buffer_in);
-    }
     if (data->freql) freqlist_free(data->freql);
     free(data);
 }
 
 
+
 /*
- * Count the frequencies.
+ * Count the frequencies. If data->stream or data->fast is
+ * TRUE, they are counted later by ah_encode: in fast mode,
+ * only the samples the blocks build their tables from.
  */
 int ah_count(ah_data *data) {
     if (!data->freql) {
         if (!ah_data_init_freql(data)) {
-            error_mem((void*)ah_data_free_resources, data);
-        }
-    }
-    do {
-        unsigned char symbol = fgetc(data->fi);   // A buffer is not used due
-        if( feof(data->fi) ) {                    // that any modern OS
-            break ;                               // has one provided by
-        }                                         // the libc library when I/O
-        if (data->buffer_in) {
-            data->buffer_in[data->length_in] = symbol;
-            if (data->length_in+1 == data->length_buff) {
-                data->length_buff += BUFFER_WINDOW;
-                data->buffer_in = (unsigned char *)realloc(data->buffer_in, data->length_buff);
-                if (!data->buffer_in) {
-                    return ERROR_MEM;
-                }
-            }
+            return ERROR_MEM;
         }
-        node_freqlist *pnode = freqlist_add(data->freql, symbol);
-        if (!pnode) {
+    }
+    if (data->stream || data->adaptive || data->fast) {
+        return OK;          // stdin or fast: each block is counted when it's encoded
+    }
+    uint64_t hist[HIST_SYMBOLS];
+    hist_clear(hist);
+    if (data->map) {
+        hist_count(hist, data->map, data->map_len);     // The file in memory
+        data->length_in = data->map_len;
+    } else {
+        unsigned char *buffer = (unsigned char *)malloc(READ_BUFFER_SIZE);
+        if (!buffer) {
             return ERROR_MEM;
         }
-        data->length_in++;
-    } while (TRUE);
+        size_t n;
+        while ((n = fread(buffer, SYMBOL_SIZE, READ_BUFFER_SIZE, data->fi)) > 0) {
+            hist_count(hist, buffer, n);
+            data->length_in += n;
+        }
+        free(buffer);
+    }
+    if (freqlist_add_hist(data->freql, hist)) {
+        return ERROR_MEM;
+    }
     freqlist_sort(data->freql);
+    data->counted = TRUE;
     return 0;
 }
 
 /*
- * Write header information in output file, including
- * the Huffman table.
+ * Build the Huffman codes from the frequencies counted: the
+ * Huffman tree, the code lengths limited to data->max_nbits,
+ * and the canonical codes.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int ah_build_codes(ah_data *data) {
+    int r = freqlist_build_huff(data->freql);
+    if (r) return r;
+    freqlist_limit_nbits(data->freql, data->max_nbits);
+    freqlist_canonical(data->freql);
+    return OK;
+}
+
+/*
+ * Write header information in output file: the
+ * format, and the size of the blocks if any.
  */
 int _ah_write_header(ah_data *data) {
     // Write "magic" number that identifies the format
@@ -175,112 +265,492 @@ int _ah_write_header(ah_data *data) {
     // Write basic header info
     fputc(data->header_flags[0], data->fo);
     fputc(data->header_flags[1], data->fo);
-    // Write original input size in bytes
-    fwrite(&data->length_in, NUMBER_SIZE, 1, data->fo);
-    // Write number of source symbols
-    unsigned short int length = data->freql->length;
-    fwrite(&length, SMALL_COUNT_SIZE, 1, data->fo);
-    // Write each node from the freqlist
-    node_freqlist *pnode = data->freql->list;
-    while(pnode) {
-        fwrite(&pnode->symb, SYMBOL_SIZE, 1, data->fo);
-        fwrite(&pnode->nbits, SYMBOL_SIZE, 1, data->fo);
-        // Write each symbol "bits" with as fewer bits as possible
-        int bytes_size = ah_bits_bytes_size(pnode->nbits);
-        if (bytes_size == 1) {
-            unsigned char bits = (unsigned char) pnode->bits;
-            fwrite(&bits, bytes_size, 1, data->fo);
-        } else if (bytes_size == 2) {
-            unsigned short bits = (unsigned short) pnode->bits;
-            fwrite(&bits, bytes_size, 1, data->fo);
-        } else if (bytes_size == 4) {
-            unsigned int bits = (unsigned int) pnode->bits;
-            fwrite(&bits, bytes_size, 1, data->fo);
-        } else if (bytes_size == 8) {
-            fwrite(&pnode->bits, bytes_size, 1, data->fo);
-        } else {
-            return INVALID_BITS_SIZE;
+    if (data->header_flags[1] & HEADER_FLAG_BLOCKS) {
+        // Write the size of the blocks
+        unsigned int block_size = BLOCK_SIZE;
+        fwrite(&block_size, COUNT_SIZE, 1, data->fo);
+    }
+    return ferror(data->fo) ? ERROR_FILE_OUT : OK;
+}
+
+/*
+ * Write the n blocks encoded: the raw length, the encoded
+ * length, and the encoded data of each one.
+ */
+int _ah_write_blocks(ah_data *data, const block *blocks, int n) {
+    for (int i = 0; i < n; i++) {
+        unsigned int len_in = blocks[i].len_in, len_out = blocks[i].len_out;
+        fwrite(&len_in, COUNT_SIZE, 1, data->fo);
+        fwrite(&len_out, COUNT_SIZE, 1, data->fo);
+        if (fwrite(blocks[i].out, 1, len_out, data->fo) != len_out) {
+            return ERROR_FILE_OUT;
         }
-        pnode = pnode->next;
+        data->length_out += blocks[i].len_out - blocks[i].len_table;
     }
     return OK;
 }
 
+/* Seek index: where each block starts, in the raw data and in the file */
+typedef struct _ah_index {
+    uint64_t *entries;          /* Pairs of offsets: raw data, file */
+    size_t n, size;
+    uint64_t raw, pos;          /* Offsets of the next block */
+} ah_index;
 
 /*
- * Encode and write the compressed data.
+ * Add to the index the n blocks written after the previous ones.
  */
-int ah_encode(ah_data *data) {
-    int r = _ah_write_header(data);
-    if (r) return r;
-
-    if (data->buffer_in) {
-        data->fi = fmemopen(data->buffer_in, data->length_in, "rb");
-    } else {
-        rewind(data->fi);
+int _ah_index_add(ah_index *idx, const block *blocks, int n) {
+    if (idx->n + n > idx->size) {
+        size_t size = idx->size ? idx->size * 2 : 1024;
+        if (size < idx->n + n) size = idx->n + n;
+        uint64_t *p = (uint64_t *) realloc(idx->entries, size * 2 * sizeof(uint64_t));
+        if (!p) return ERROR_MEM;
+        idx->entries = p;
+        idx->size = size;
     }
-    unsigned long int dword = 0l;   // Word used during encoding
-    int nbits = 0;                  // Number of bits used in dword
-    unsigned char c;                // Read here input file byte by byte
-    node_freqlist *pnode;           // Current node to be written
-    do {
-        c = fgetc(data->fi);
-        if(feof(data->fi)) break;
-        pnode = freqlist_find(data->freql, c);
-        // If nbits + pnode->nbits > 32, pull off a byte
-        while(nbits + pnode->nbits > 32) {
-            c = dword >> (nbits - 8);                   // Extract the 8 bits with higher
-            fwrite(&c, SYMBOL_SIZE, 1, data->fo);       // order and write down into the file.
-            nbits -= 8;                                 // Now we have those 8 bits available
-            data->length_out += SYMBOL_SIZE;
-        }
-        dword <<= pnode->nbits;                         // Make room for the new byte
-        dword |= pnode->bits;                           // Insert the new byte
-        nbits += pnode->nbits;                          // Update the number of bits
-    } while(TRUE);
-    while(nbits > 0) {                                  // Extract the 4 bytes remaining in dword
-        if(nbits>=8) c = dword >> (nbits - 8);
-        else c = dword << (8 - nbits);
-        fwrite(&c, SYMBOL_SIZE, 1, data->fo);
-        nbits -= 8;
-        data->length_out += SYMBOL_SIZE;
+    for (int i = 0; i < n; i++, idx->n++) {
+        idx->entries[idx->n * 2] = idx->raw;
+        idx->entries[idx->n * 2 + 1] = idx->pos;
+        idx->raw += blocks[i].len_in;
+        idx->pos += 2 * COUNT_SIZE + blocks[i].len_out;
     }
     return OK;
 }
 
-int _ah_read_header(ah_data *data) {
-    data->freql = freqlist_create();
-    if (!data->freql) {
+/*
+ * Write the index after the end of the blocks: the offset in the
+ * raw data and the offset in the file of each block, and then
+ * the number of blocks.
+ */
+int _ah_write_index(ah_data *data, const ah_index *idx) {
+    for (size_t i = 0; i < idx->n * 2; i++) {
+        fwrite(&idx->entries[i], NUMBER_SIZE, 1, data->fo);
+    }
+    uint64_t n = idx->n;
+    fwrite(&n, NUMBER_SIZE, 1, data->fo);
+    return ferror(data->fo) ? ERROR_FILE_OUT : OK;
+}
+
+/*
+ * Encode the input with the adaptive Huffman codes, in one pass.
+ * The input is read with read(2), that returns what is available
+ * in pipes, and the codes are written as soon as they are encoded,
+ * except the bits of the last byte that is not complete.
+ */
+int _ah_encode_adaptive(ah_data *data) {
+    adapt_model *m = (adapt_model *)malloc(sizeof(adapt_model));
+    unsigned char *buffer = (unsigned char *)malloc(READ_BUFFER_SIZE);
+    bitwriter bw;
+    if (!m || !buffer || bitwriter_init(&bw, WRITE_BUFFER_SIZE, data->fo)) {
+        free(m);
+        free(buffer);
         return ERROR_MEM;
     }
-    data->freql->tree = freqlist_create_node((unsigned char)0, (unsigned char)0, 0l);
-    if (!data->freql->tree) {
+    adapt_init(m);
+    int r = fflush(data->fo) ? ERROR_FILE_OUT : OK;
+    size_t pos = 0;
+    while (!r) {
+        const unsigned char *in = buffer;
+        ssize_t n;
+        if (data->map) {
+            in = data->map + pos;
+            n = data->map_len - pos < READ_BUFFER_SIZE ? data->map_len - pos : READ_BUFFER_SIZE;
+            pos += n;
+        } else {
+            n = read(fileno(data->fi), buffer, READ_BUFFER_SIZE);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) r = ERROR_READ;
+        }
+        if (n <= 0) break;
+        for (ssize_t i = 0; i < n; i++) {
+            adapt_encode(m, in[i], &bw);
+        }
+        data->length_in += n;
+        r = bitwriter_flush(&bw);
+        if (!r && fflush(data->fo)) r = ERROR_FILE_OUT;
+    }
+    if (!r) {
+        adapt_encode(m, ADAPT_END, &bw);
+        r = bitwriter_finish(&bw);
+    }
+    data->length_out = bw.length;
+    bitwriter_free(&bw);
+    free(buffer);
+    free(m);
+    return r;
+}
+
+/* Input of a batch of blocks, read while the previous batch is encoded */
+typedef struct _ah_read_task {
+    ah_data *data;
+    unsigned char *buffer;      /* Where the input is read, NULL if mapped */
+    size_t size;                /* Size of buffer */
+    const unsigned char *in;    /* Input read */
+    size_t len;                 /* Bytes of in */
+} ah_read_task;
+
+/* Blocks written while the next batch is encoded or decoded */
+typedef struct _ah_write_task {
+    ah_data *data;
+    const block *blocks;
+    int n;
+    uint64_t raw;               /* Offset of the first block in the raw
+                                   data (to decode) */
+    int error;
+} ah_write_task;
+
+/* Task body, read the input of the next batch */
+void *_ah_read_input(void *arg) {
+    ah_read_task *t = (ah_read_task *) arg;
+    ah_data *data = t->data;
+    if (data->map) {
+        t->in = data->map + data->map_pos;
+        t->len = data->map_len - data->map_pos < t->size
+                 ? data->map_len - data->map_pos : t->size;
+        data->map_pos += t->len;
+    } else {
+        t->in = t->buffer;
+        t->len = fread(t->buffer, SYMBOL_SIZE, t->size, data->fi);
+    }
+    return NULL;
+}
+
+/* Task body, write the blocks encoded */
+void *_ah_write_encoded(void *arg) {
+    ah_write_task *t = (ah_write_task *) arg;
+    t->error = _ah_write_blocks(t->data, t->blocks, t->n);
+    return NULL;
+}
+
+/*
+ * Encode the blocks data->threads at once: while a batch of blocks
+ * is encoded, the previous one is written and the input of the next
+ * one is read, each one in its own thread.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int _ah_encode_batches(ah_data *data, uint64_t hist[HIST_SYMBOLS], ah_index *idx) {
+    int nblocks = data->threads;
+    size_t size = (size_t) nblocks * BLOCK_SIZE;
+    // Two batches of blocks, one encoded while the other one is written
+    block *blocks = (block *)malloc(2 * nblocks * sizeof(block));
+    // With the file in memory, the blocks are taken from there
+    unsigned char *buffer = data->map ? NULL : (unsigned char *)malloc(2 * size);
+    if (!blocks || (!buffer && !data->map)) {
+        free(blocks);
+        free(buffer);
         return ERROR_MEM;
     }
-    char magic_number[MAGIC_NUMBER_SIZE];
-    fread(&magic_number, MAGIC_NUMBER_SIZE, 1, data->fi);
-    if (strcmp(magic_number, MAGIC_NUMBER) != 0) {
-        return INVALID_FILE_IN;
+    for (int i = 0; i < 2 * nblocks; i++) {
+        block_init(&blocks[i]);
+        blocks[i].max_nbits = data->max_nbits;
+        blocks[i].streams = data->streams;
+        blocks[i].context = data->context;
+        blocks[i].fast = data->fast;
     }
-    data->header_flags[0] = fgetc(data->fi);
-    if (data->header_flags[0] != VERSION_BYTE) {
-        return INVALID_FILE_IN;     // Different version not supported?
+    ah_read_task reads[2] = {
+        { data, buffer, size, NULL, 0 },
+        { data, buffer ? buffer + size : NULL, size, NULL, 0 }
+    };
+    ah_write_task write = { data, NULL, 0, 0, OK };
+    aio_task reader, writer;
+    int r = OK;
+    _ah_read_input(&reads[0]);
+    for (int cur = 0; !r && reads[cur].len > 0; cur = 1 - cur) {
+        block *b = blocks + cur * nblocks;
+        const unsigned char *in = reads[cur].in;
+        size_t len = reads[cur].len;
+        int n = 0;
+        for (size_t offset = 0; offset < len; offset += BLOCK_SIZE, n++) {
+            b[n].in = in + offset;
+            b[n].len_in = len - offset < BLOCK_SIZE ? len - offset : BLOCK_SIZE;
+        }
+        aio_start(&reader, _ah_read_input, &reads[1 - cur]);
+        if (write.n) aio_start(&writer, _ah_write_encoded, &write);
+        r = block_encode_all(b, n, data->threads);
+        aio_wait(&reader);
+        if (write.n) {
+            aio_wait(&writer);
+            if (!r) r = write.error;
+        }
+        if (!r && data->index) r = _ah_index_add(idx, b, n);
+        if (!data->counted) {
+            for (int i = 0; i < n; i++) {
+                hist_merge(hist, b[i].hist);
+            }
+            data->length_in += len;
+        }
+        write.blocks = b;
+        write.n = n;
     }
-    data->header_flags[1] = fgetc(data->fi);
-    if (data->header_flags[1] != FLAGS_1_BYTE) {
-        return INVALID_FILE_IN;     // New flags not supported?
+    if (!r && write.n) {
+        r = _ah_write_blocks(data, write.blocks, write.n);     // The last batch
     }
-    // Original input size in bytes
-    fread(&data->length_in, NUMBER_SIZE, 1, data->fi);
-    if (data->length_in == 0) return 0; // Empty file
+    for (int i = 0; i < 2 * nblocks; i++) {
+        block_free(&blocks[i]);
+    }
+    free(blocks);
+    free(buffer);
+    return r;
+}
+
+/*
+ * Pipeline to encode, with a stage in each thread: the reader reads
+ * the input of each block and passes the blocks to the encoders in
+ * turns, each encoder counts the symbols of its blocks, builds their
+ * tables and encodes them, and the writer writes them in order. The
+ * stages pass the blocks with rings, and the blocks go back from the
+ * writer to the reader to be reused, so only a few blocks are in the
+ * pipeline. NULL marks the end.
+ */
+typedef struct _ah_pipeline {
+    ah_data *data;
+    int nencoders;
+    ring free;                      /* Blocks written, to the reader */
+    ring read[MAX_THREADS];         /* Blocks read, to each encoder */
+    ring encode[MAX_THREADS];       /* Blocks encoded, to the writer */
+    int stop;                       /* Set by the writer after an error */
+} ah_pipeline;
+
+/* Encoder of the pipeline, with the number of its rings */
+typedef struct _ah_pipeline_encoder {
+    ah_pipeline *p;
+    int i;
+} ah_pipeline_encoder;
+
+/* Reader stage, read the input of each block until the end */
+void *_ah_pipeline_read(void *arg) {
+    ah_pipeline *p = (ah_pipeline *) arg;
+    ah_data *data = p->data;
+    size_t len = BLOCK_SIZE;
+    int i = 0;
+    while (len == BLOCK_SIZE && !__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+        block *b = (block *) ring_pop(&p->free);
+        if (data->map) {
+            len = data->map_len - data->map_pos < BLOCK_SIZE ? data->map_len - data->map_pos : BLOCK_SIZE;
+            b->in = data->map + data->map_pos;
+            data->map_pos += len;
+        } else {
+            b->error = block_reserve(&b->own_in, &b->size_in, BLOCK_SIZE);
+            len = b->error ? 0 : fread(b->own_in, SYMBOL_SIZE, BLOCK_SIZE, data->fi);
+            b->in = b->own_in;
+        }
+        b->len_in = len;
+        if (len > 0 || b->error) {
+            ring_push(&p->read[i], b);
+            i = (i + 1) % p->nencoders;
+        }
+    }
+    for (i = 0; i < p->nencoders; i++) {
+        ring_push(&p->read[i], NULL);
+    }
+    return NULL;
+}
+
+/* Encoder stage, count and encode the blocks of its turn */
+void *_ah_pipeline_encode(void *arg) {
+    ah_pipeline_encoder *e = (ah_pipeline_encoder *) arg;
+    block *b;
+    while ((b = (block *) ring_pop(&e->p->read[e->i]))) {
+        if (!b->error) {
+            b->error = b->context ? block_encode_context(b) : block_encode(b);
+        }
+        ring_push(&e->p->encode[e->i], b);
+    }
+    ring_push(&e->p->encode[e->i], NULL);
+    return NULL;
+}
+
+/*
+ * Encode the blocks with a pipeline of threads, the current
+ * thread the writer, with data->threads encoders. The output is
+ * the same as encoding the blocks in batches.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int _ah_encode_pipeline(ah_data *data, uint64_t hist[HIST_SYMBOLS], ah_index *idx) {
+    ah_pipeline p;
+    p.data = data;
+    p.nencoders = data->threads;
+    p.stop = FALSE;
+    int nblocks = p.nencoders * PIPELINE_DEPTH + 2, rings = 0, r = OK;
+    block *blocks = (block *)malloc(nblocks * sizeof(block));
+    // All the blocks fit in any ring, so pushing never waits
+    if (!blocks || ring_init(&p.free, nblocks)) {
+        r = ERROR_MEM;
+    }
+    for (; !r && rings < p.nencoders; rings++) {
+        if (ring_init(&p.read[rings], nblocks + 1)) r = ERROR_MEM;
+        else if (ring_init(&p.encode[rings], nblocks + 1)) {
+            ring_free(&p.read[rings]);
+            r = ERROR_MEM;
+        }
+    }
+    if (!r) {
+        for (int i = 0; i < nblocks; i++) {
+            block_init(&blocks[i]);
+            blocks[i].max_nbits = data->max_nbits;
+            blocks[i].streams = data->streams;
+            blocks[i].context = data->context;
+            blocks[i].fast = data->fast;
+            ring_push(&p.free, &blocks[i]);
+        }
+        data->map_pos = 0;
+        ah_pipeline_encoder encoders[MAX_THREADS];
+        pthread_t threads[MAX_THREADS], reader;
+        int started = 0, reading = FALSE;
+        for (; started < p.nencoders; started++) {
+            encoders[started] = (ah_pipeline_encoder) { &p, started };
+            if (pthread_create(&threads[started], NULL, _ah_pipeline_encode, &encoders[started])) break;
+        }
+        reading = started == p.nencoders && !pthread_create(&reader, NULL, _ah_pipeline_read, &p);
+        if (!reading) {
+            // End the encoders started
+            r = ERROR_THREAD;
+            for (int i = 0; i < started; i++) ring_push(&p.read[i], NULL);
+        }
+        block *b;
+        for (int i = 0; started > 0 && (b = (block *) ring_pop(&p.encode[i])); i = (i + 1) % p.nencoders) {
+            if (!r) r = b->error;
+            if (!r) r = _ah_write_blocks(data, b, 1);
+            if (!r && data->index) r = _ah_index_add(idx, b, 1);
+            if (!r && !data->counted) {
+                hist_merge(hist, b->hist);
+                data->length_in += b->len_in;
+            }
+            if (r) __atomic_store_n(&p.stop, TRUE, __ATOMIC_RELEASE);
+            ring_push(&p.free, b);
+        }
+        if (reading) pthread_join(reader, NULL);
+        for (int i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        for (int i = 0; i < nblocks; i++) {
+            block_free(&blocks[i]);
+        }
+    }
+    for (int i = 0; i < rings; i++) {
+        ring_free(&p.read[i]);
+        ring_free(&p.encode[i]);
+    }
+    ring_free(&p.free);
+    free(blocks);
+    return r;
+}
+
+/*
+ * Encode and write the compressed data. If the frequencies were
+ * not counted by ah_count, count them from the blocks encoded.
+ * The input is split in blocks of BLOCK_SIZE bytes, each one
+ * encoded with its own table. With one thread the blocks are
+ * encoded in batches, overlapped with the reading and writing,
+ * and with more threads with a pipeline of threads, so only the
+ * memory for a few blocks is used.
+ * The end is marked with a block of length 0, followed
+ * by the seek index if data->index is TRUE.
+ */
+int ah_encode(ah_data *data) {
+    int r = _ah_write_header(data);
+    if (r) return r;
+    if (data->adaptive) {
+        return _ah_encode_adaptive(data);
+    }
+    uint64_t hist[HIST_SYMBOLS];
+    hist_clear(hist);
+    ah_index idx = { NULL, 0, 0, 0, MAGIC_NUMBER_SIZE + 2 + COUNT_SIZE };
+    if (!data->stream && !data->map) {
+        rewind(data->fi);
+    }
+    data->map_pos = 0;
+    r = data->threads > 1 ? _ah_encode_pipeline(data, hist, &idx)
+                          : _ah_encode_batches(data, hist, &idx);
+    if (!r) {
+        unsigned int end = 0;
+        if (fwrite(&end, COUNT_SIZE, 1, data->fo) != 1) r = ERROR_FILE_OUT;
+    }
+    if (!r && data->index) {
+        r = _ah_write_index(data, &idx);
+    }
+    if (!r && !data->counted) {
+        if (!data->freql && !ah_data_init_freql(data)) {
+            r = ERROR_MEM;
+        } else if (freqlist_add_hist(data->freql, hist)) {
+            r = ERROR_MEM;
+        } else {
+            freqlist_sort(data->freql);
+        }
+    }
+    free(idx.entries);
+    return r;
+}
+
+/*
+ * Insert the leaf p in the tree of l, creating the
+ * intermediate nodes of the path given by the code of p.
+ */
+int _ah_tree_insert(freqlist *l, node_freqlist *p) {
+    unsigned long j = p->nbits ? 1UL << (p->nbits-1) : 0;          // Insert node in place
+    node_freqlist* q = l->tree;
+    while(j > 1) {
+        if(p->bits & j) {                                           // It's a one
+            if (q->one) {                                           // If node exist,
+                q = q->one;                                         // move to it
+            } else {                                                // else it's created
+                q->one = freqlist_create_node((unsigned char)0, (unsigned char)0, 0l);
+                if (!q->one) return ERROR_MEM;
+                q = q->one;
+            }
+        } else {                                                    // It's a zero
+            if(q->zero) {
+                q = q->zero;
+            } else {
+                q->zero = freqlist_create_node((unsigned char)0, (unsigned char)0, 0l);
+                if (!q->zero) return ERROR_MEM;
+                q = q->zero;
+            }
+        }
+        j >>= 1;                                                    // Next bit
+    }
+    // Last bit
+    if(p->bits & 1) {                                               // It's a one
+        q->one = p;
+    } else {                                                        // It's a zero
+        q->zero = p;
+    }
+    return OK;
+}
 
+/*
+ * Append a new node to the list of l (not sorted),
+ * and insert it in the tree.
+ */
+node_freqlist *_ah_append_node(freqlist *l, node_freqlist **plast) {
+    node_freqlist* p = freqlist_create_node(0, 0, 0l);
+    if (!p) return NULL;
+    if (*plast) {
+        (*plast)->next = p;
+        p->prev = *plast;
+        p->pos = (*plast)->pos + 1;
+    } else {
+        l->list = p;
+    }
+    *plast = p;
+    l->length++;
+    return p;
+}
+
+/*
+ * Read the table of the format version 1, that has the symbols
+ * with its binary codes, and build the Huffman tree.
+ */
+int _ah_read_table_v1(ah_data *data, code_table *t) {
     // Number of source symbols
     unsigned short int length;
-    fread(&length, SMALL_COUNT_SIZE, 1, data->fi);
-    data->freql->length = length;
-
-    for(unsigned int i = 0; i < data->freql->length; i++) {         // Read all elements
-        node_freqlist* p = freqlist_create_node(0, 0, 0l);
+    if (fread(&length, SMALL_COUNT_SIZE, 1, data->fi) != 1) {
+        return INVALID_FILE_IN;
+    }
+    node_freqlist* plast = NULL;
+    for(unsigned int i = 0; i < length; i++) {                      // Read all elements
+        node_freqlist* p = _ah_append_node(data->freql, &plast);
         if (!p) return ERROR_MEM;
         fread(&p->symb, SYMBOL_SIZE, 1, data->fi);                  // Read node values
         fread(&p->nbits, SYMBOL_SIZE, 1, data->fi);
@@ -302,92 +772,481 @@ int _ah_read_header(ah_data *data) {
         } else {
             return INVALID_BITS_SIZE;
         }
-        int j = 1 << (p->nbits-1);                                  // Insert node in place
-        node_freqlist* q = data->freql->tree;
-        while(j > 1) {
-            if(p->bits & j) {                                       // It's a one
-                if (q->one) {                                       // If node exist,
-                    q = q->one;                                     // move to it
-                } else {                                            // else it's created
-                    q->one = freqlist_create_node((unsigned char)0, (unsigned char)0, 0l);
-                    if (!q->one) return ERROR_MEM;
-                    q = q->one;
-                    q->symb = 0;
-                    q->one = q->zero = NULL;
-                }
-            } else {                                                // It's a zero
-                if(q->zero) {
-                    q = q->zero;
-                } else {
-                    q->zero = freqlist_create_node((unsigned char)0, (unsigned char)0, 0l);
-                    if (!q->zero) return ERROR_MEM;
-                    q = q->zero;
-                    q->symb = 0;
-                    q->one = q->zero = NULL;
-                }
+        int r = _ah_tree_insert(data->freql, p);
+        if (r) return r;
+    }
+    return code_table_build(t, data->freql);
+}
+
+/*
+ * Build the freqlist and the tree of data from the codes
+ * of the table, to print them in verbose mode.
+ */
+int _ah_table_freqlist(ah_data *data, const code_table *t) {
+    node_freqlist* plast = NULL;
+    for (int nbits = t->max_nbits == 0 ? 0 : 1; nbits <= t->max_nbits; nbits++) {
+        for (int c = 0; c < 256; c++) {
+            if (t->codes[c].nbits != nbits || (nbits == 0 && c != t->single_symb)) {
+                continue;
             }
-            j >>= 1;                                                // Next bit
+            node_freqlist* p = _ah_append_node(data->freql, &plast);
+            if (!p) return ERROR_MEM;
+            p->symb = c;
+            p->bits = t->codes[c].bits;
+            p->nbits = nbits;
+            int r = _ah_tree_insert(data->freql, p);
+            if (r) return r;
         }
-        // Last bit
-        if(p->bits & 1) {                                           // It's a one
-            q->one = p;
-        } else {                                                    // It's a zero
-            q->zero = p;
+    }
+    return OK;
+}
+
+/*
+ * Read the table of the format version 2, with the canonical
+ * code lengths, and assign the canonical codes.
+ * The freqlist and tree are only built in verbose mode.
+ */
+int _ah_read_table_v2(ah_data *data, code_table *t) {
+    // The size of the table is known after its first bytes
+    unsigned char buffer[CODE_TABLE_MAX_SIZE];
+    size_t len = SMALL_COUNT_SIZE + 1, used;
+    if (fread(buffer, 1, len, data->fi) != len) {
+        return INVALID_FILE_IN;
+    }
+    unsigned short int length;
+    memcpy(&length, buffer, SMALL_COUNT_SIZE);
+    int max_nbits = buffer[SMALL_COUNT_SIZE];
+    size_t rest = (max_nbits ? max_nbits - 1 : 0) + (length <= 256 ? length : 0);
+    if (fread(buffer + len, 1, rest, data->fi) != rest) {
+        return INVALID_FILE_IN;
+    }
+    int r = code_table_read(t, buffer, len + rest, &used);
+    if (r) return r;
+    return data->verbose ? _ah_table_freqlist(data, t) : OK;
+}
+
+/*
+ * Read the header of the compressed file, and the table with
+ * the codes in the format of its version. If the data is stored
+ * in blocks, the size of the blocks is read instead of the table.
+ */
+int _ah_read_header(ah_data *data, code_table *t, unsigned int *block_size) {
+    data->freql = freqlist_create();
+    if (!data->freql) {
+        return ERROR_MEM;
+    }
+    data->freql->tree = freqlist_create_node((unsigned char)0, (unsigned char)0, 0l);
+    if (!data->freql->tree) {
+        return ERROR_MEM;
+    }
+    char magic_number[MAGIC_NUMBER_SIZE];
+    if (fread(&magic_number, MAGIC_NUMBER_SIZE, 1, data->fi) != 1
+            || memcmp(magic_number, MAGIC_NUMBER, MAGIC_NUMBER_SIZE) != 0) {
+        return INVALID_FILE_IN;
+    }
+    data->header_flags[0] = fgetc(data->fi);
+    data->header_flags[1] = fgetc(data->fi);
+    if (ah_check_header_flags(data->header_flags)) {
+        return INVALID_FILE_IN;
+    }
+    if (data->header_flags[1] & HEADER_FLAG_ADAPTIVE) {
+        return OK;                  // No table, the codes follow
+    }
+    data->streams = data->header_flags[1] & HEADER_FLAG_STREAMS ? CODEC_STREAMS : 1;
+    data->context = data->header_flags[1] & HEADER_FLAG_CONTEXT ? TRUE : FALSE;
+    if (data->header_flags[1] & HEADER_FLAG_BLOCKS) {
+        if (fread(block_size, COUNT_SIZE, 1, data->fi) != 1
+                || *block_size == 0 || *block_size > MAX_BLOCK_SIZE) {
+            return INVALID_FILE_IN;
+        }
+        return OK;
+    }
+    // Original input size in bytes
+    if (fread(&data->length_in, NUMBER_SIZE, 1, data->fi) != 1) {
+        return INVALID_FILE_IN;
+    }
+    if (data->length_in == 0) return 0; // Empty file
+
+    if (data->header_flags[0] == VERSION_BYTE_V1) {
+        return _ah_read_table_v1(data, t);
+    }
+    return _ah_read_table_v2(data, t);
+}
+
+/*
+ * Write the n bytes of buf, that start at the offset raw
+ * of the raw data, or only the part of them in the range
+ * to decode if data->range is TRUE.
+ */
+int _ah_write_raw(ah_data *data, const unsigned char *buf, size_t n, uint64_t raw) {
+    if (data->range) {
+        uint64_t from = data->range_offset, to = from + data->range_length;
+        if (to < from) to = UINT64_MAX;
+        if (raw + n <= from || raw >= to) {
+            return OK;
+        }
+        if (raw < from) {
+            buf += from - raw;
+            n -= from - raw;
+            raw = from;
         }
+        if (raw + n > to) n = to - raw;
+    }
+    return fwrite(buf, SYMBOL_SIZE, n, data->fo) == n ? OK : ERROR_FILE_OUT;
+}
+
+/*
+ * Return TRUE if the raw data from the offset raw is
+ * after the range to decode.
+ */
+int _ah_after_range(const ah_data *data, uint64_t raw) {
+    return data->range && raw >= data->range_offset
+                       && raw - data->range_offset >= data->range_length;
+}
+
+/*
+ * Read len bytes of the input into buf, from the map if the
+ * input is mapped in memory.
+ * Return 0 if no errors, otherwise INVALID_FILE_IN.
+ */
+int _ah_read(ah_data *data, void *buf, size_t len) {
+    if (data->map) {
+        if (data->map_len - data->map_pos < len) return INVALID_FILE_IN;
+        memcpy(buf, data->map + data->map_pos, len);
+        data->map_pos += len;
+        return OK;
+    }
+    return fread(buf, 1, len, data->fi) == len ? OK : INVALID_FILE_IN;
+}
+
+/* Skip len bytes of the input, seeking if it's possible */
+int _ah_skip(ah_data *data, size_t len) {
+    if (data->map) {
+        if (data->map_len - data->map_pos < len) return INVALID_FILE_IN;
+        data->map_pos += len;
+        return OK;
+    }
+    FILE *fi = data->fi;
+    if (!fseeko(fi, len, SEEK_CUR)) {
+        return OK;
+    }
+    unsigned char buffer[READ_BUFFER_SIZE / 16];
+    while (len) {
+        size_t n = len < sizeof(buffer) ? len : sizeof(buffer);
+        if (fread(buffer, 1, n, fi) != n) return INVALID_FILE_IN;
+        len -= n;
     }
     return OK;
 }
 
+/*
+ * Move the input to the last block that starts before the range
+ * to decode, with the seek index, and set in raw the offset of the
+ * block in the raw data. Without index, or if the input is not a
+ * regular file, the input is not moved.
+ */
+int _ah_seek_index(ah_data *data, uint64_t *raw) {
+    off_t size = _ah_regular_file_size(data->fi);
+    off_t start = ftello(data->fi);
+    if (!(data->header_flags[1] & HEADER_FLAG_INDEX) || size < 0 || start < 0) {
+        return OK;
+    }
+    uint64_t n, entry[2];
+    if (fseeko(data->fi, size - NUMBER_SIZE, SEEK_SET)
+            || fread(&n, NUMBER_SIZE, 1, data->fi) != 1
+            || n > (uint64_t) (size - start) / (2 * NUMBER_SIZE)) {
+        return INVALID_FILE_IN;
+    }
+    off_t entries = size - NUMBER_SIZE - (off_t) n * 2 * NUMBER_SIZE;
+    // Binary search of the last block that starts before the range
+    uint64_t lo = 0, hi = n, pos = start;
+    *raw = 0;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (fseeko(data->fi, entries + (off_t) mid * 2 * NUMBER_SIZE, SEEK_SET)
+                || fread(entry, NUMBER_SIZE, 2, data->fi) != 2) {
+            return INVALID_FILE_IN;
+        }
+        if (entry[0] <= data->range_offset) {
+            *raw = entry[0];
+            pos = entry[1];
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (pos < (uint64_t) start || pos >= (uint64_t) entries
+            || fseeko(data->fi, pos, SEEK_SET)) {
+        return INVALID_FILE_IN;
+    }
+    return OK;
+}
+
+/*
+ * Read the next n blocks, at most, into blocks, skipping the
+ * blocks before the range to decode. raw is the offset in the
+ * raw data of the next block, updated with the blocks skipped.
+ * Set in end if the block that marks the end was read, or the
+ * next block is after the range to decode.
+ * Return the number of blocks read, or -1 if the file is invalid.
+ */
+int _ah_read_blocks(ah_data *data, block *blocks, int n, unsigned int block_size,
+                    uint64_t *raw, int *end) {
+    int i = 0;
+    uint64_t next = *raw;
+    while (i < n) {
+        unsigned int len_in, len_out;
+        if (_ah_after_range(data, next)) {
+            *end = TRUE;
+            break;
+        }
+        if (_ah_read(data, &len_out, COUNT_SIZE) || len_out > block_size) {
+            return -1;
+        }
+        if (len_out == 0) {
+            *end = TRUE;
+            break;
+        }
+        if (_ah_read(data, &len_in, COUNT_SIZE) || len_in > block_max_encoded(len_out)) {
+            return -1;
+        }
+        if (data->range && next + len_out <= data->range_offset) {
+            // Before the range, not decoded
+            if (_ah_skip(data, len_in)) return -1;
+            next = *raw += len_out;
+            continue;
+        }
+        block *b = &blocks[i++];
+        if (data->map) {
+            // The block decoded from the map, without copying it
+            if (data->map_len - data->map_pos < len_in) return -1;
+            b->in = data->map + data->map_pos;
+            data->map_pos += len_in;
+        } else {
+            if (block_reserve(&b->own_in, &b->size_in, len_in)
+                    || fread(b->own_in, 1, len_in, data->fi) != len_in) {
+                return -1;
+            }
+            b->in = b->own_in;
+        }
+        b->len_in = len_in;
+        b->len_out = len_out;
+        b->stored = data->header_flags[1] & HEADER_FLAG_STORED && len_in == len_out;
+        next += len_out;
+    }
+    return i;
+}
+
+/* Blocks of a batch, read while the previous batch is decoded */
+typedef struct _ah_read_blocks_task {
+    ah_data *data;
+    block *blocks;
+    int nblocks;
+    unsigned int block_size;
+    uint64_t *next;             /* Offset in the raw data after the
+                                   batches read, shared by the tasks */
+    uint64_t raw;               /* Offset of the first block read */
+    int n;                      /* Blocks read, -1 if the input is not valid */
+    int end;                    /* TRUE if the end was read */
+} ah_read_blocks_task;
+
+/* Task body, read the blocks of the next batch */
+void *_ah_read_batch(void *arg) {
+    ah_read_blocks_task *t = (ah_read_blocks_task *) arg;
+    t->raw = *t->next;
+    t->n = _ah_read_blocks(t->data, t->blocks, t->nblocks, t->block_size, &t->raw, &t->end);
+    *t->next = t->raw;
+    for (int i = 0; i < t->n; i++) {
+        *t->next += t->blocks[i].len_out;
+    }
+    return NULL;
+}
+
+/* Task body, write the raw data of the blocks decoded */
+void *_ah_write_decoded(void *arg) {
+    ah_write_task *t = (ah_write_task *) arg;
+    uint64_t raw = t->raw;
+    t->error = OK;
+    for (int i = 0; i < t->n && !t->error; i++) {
+        t->error = _ah_write_raw(t->data, t->blocks[i].out, t->blocks[i].len_out, raw);
+        raw += t->blocks[i].len_out;
+    }
+    return NULL;
+}
+
+/*
+ * Decode the data stored in blocks, data->threads blocks at once.
+ * While a batch of blocks is decoded, the previous one is written
+ * and the next one is read, each one in its own thread.
+ */
+int _ah_decode_blocks(ah_data *data, unsigned int block_size) {
+    uint64_t next = 0;
+    if (data->range) {
+        int r = _ah_seek_index(data, &next);
+        if (r) return r;
+    }
+    data->map_pos = ftello(data->fi);   // The blocks start after the header
+    int nblocks = data->threads;
+    // Three batches of blocks: read, decoded and written at the same time
+    block *blocks = (block *)malloc(3 * nblocks * sizeof(block));
+    if (!blocks) return ERROR_MEM;
+    ah_read_blocks_task reads[3];
+    for (int i = 0; i < 3 * nblocks; i++) {
+        block_init(&blocks[i]);
+        blocks[i].streams = data->streams;
+        blocks[i].context = data->context;
+    }
+    for (int i = 0; i < 3; i++) {
+        reads[i] = (ah_read_blocks_task) { data, blocks + i * nblocks, nblocks, block_size,
+                                           &next, 0, 0, FALSE };
+    }
+    block_tables tables;
+    block_tables_init(&tables);
+    ah_write_task write = { data, NULL, 0, 0, OK };
+    aio_task reader, writer;
+    int r = OK;
+    _ah_read_batch(&reads[0]);
+    for (int cur = 0; !r && reads[cur].n != 0; cur = (cur + 1) % 3) {
+        ah_read_blocks_task *t = &reads[cur], *t_next = &reads[(cur + 1) % 3];
+        if (t->n < 0) {
+            r = INVALID_FILE_IN;
+            break;
+        }
+        int reading = !t->end;
+        if (reading) {
+            aio_start(&reader, _ah_read_batch, t_next);
+        } else {
+            t_next->n = 0;
+        }
+        if (write.n) aio_start(&writer, _ah_write_decoded, &write);
+        r = block_decode_all(t->blocks, t->n, data->threads, &tables);
+        if (reading) aio_wait(&reader);
+        if (write.n) {
+            aio_wait(&writer);
+            if (!r) r = write.error;
+        }
+        for (int i = 0; i < t->n && !r; i++) {
+            data->length_in += t->blocks[i].len_out;
+            data->length_out += t->blocks[i].len_in - t->blocks[i].len_table;
+        }
+        int first = 0;
+        while (first < t->n && t->blocks[first].stored) first++;
+        if (!r && data->verbose && !data->freql->list && first < t->n) {
+            // The tree printed is the tree of the first block encoded (of its first context)
+            block *b = &t->blocks[first];
+            code_table table;
+            size_t used, skip = data->context ? BLOCK_CONTEXT_MAP_SIZE : 0;
+            r = b->len_in < skip ? INVALID_FILE_IN
+                : code_table_read(&table, b->in + skip, b->len_in - skip, &used);
+            if (!r) r = _ah_table_freqlist(data, &table);
+        }
+        write.blocks = t->blocks;
+        write.n = t->n;
+        write.raw = t->raw;
+    }
+    if (!r && write.n) {
+        _ah_write_decoded(&write);              // The last batch
+        r = write.error;
+    }
+    for (int i = 0; i < 3 * nblocks; i++) {
+        block_free(&blocks[i]);
+    }
+    block_tables_free(&tables);
+    free(blocks);
+    return r;
+}
+
+/*
+ * Initialize br to read the codes after the header, from the map
+ * if the input is mapped in memory, otherwise from the file.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int _ah_bitreader_init(ah_data *data, bitreader *br) {
+    if (data->map) {
+        data->map_pos = ftello(data->fi);
+        bitreader_init_mem(br, data->map + data->map_pos, data->map_len - data->map_pos);
+        return OK;
+    }
+    return bitreader_init(br, READ_BUFFER_SIZE, data->fi);
+}
+
+/*
+ * Decode the adaptive Huffman codes until the end symbol.
+ */
+int _ah_decode_adaptive(ah_data *data) {
+    adapt_model *m = (adapt_model *)malloc(sizeof(adapt_model));
+    unsigned char *buffer = (unsigned char *)malloc(WRITE_BUFFER_SIZE);
+    bitreader br;
+    if (!m || !buffer || _ah_bitreader_init(data, &br)) {
+        free(m);
+        free(buffer);
+        return ERROR_MEM;
+    }
+    adapt_init(m);
+    int r = OK, symb = 0;
+    while (!r && symb != ADAPT_END && !_ah_after_range(data, data->length_in)) {
+        size_t n = 0;
+        while (n < WRITE_BUFFER_SIZE && !(r = adapt_decode(m, &br, &symb)) && symb != ADAPT_END) {
+            buffer[n++] = symb;
+        }
+        if (!r) r = _ah_write_raw(data, buffer, n, data->length_in);
+        data->length_in += n;
+    }
+    bitreader_free(&br);
+    free(buffer);
+    free(m);
+    return r;
+}
+
 /*
  * Decode and write the raw data.
  */
 int ah_decode(ah_data *data) {
-    int r = _ah_read_header(data);
+    code_table table;
+    unsigned int block_size;
+    int r = _ah_read_header(data, &table, &block_size);
     if (r) return r;
-
-    // Read compressed data and extract to the output stream
-    unsigned int bits = 0;
-    unsigned char a = 0;
-    // Read the first 4 bytes in the double word bits
-    if (!feof(data->fi)) {
-        fread(&a, SYMBOL_SIZE, 1, data->fi);
-        bits |= a;
-    }
-    bits <<= 8;
-    if (!feof(data->fi)) {
-        fread(&a, SYMBOL_SIZE, 1, data->fi);
-        bits |= a;
-    }
-    bits <<= 8;
-    if (!feof(data->fi)) {
-        fread(&a, SYMBOL_SIZE, 1, data->fi);
-        bits |= a;
-    }
-    bits <<= 8;
-    if (!feof(data->fi)) {
-        fread(&a, SYMBOL_SIZE, 1, data->fi);
-        bits |= a;
-    }
-    int j = 0;      /* Each 8 bits another byte is read */
-    node_freqlist* q = data->freql->tree;
-
-    do {
-        if (bits & 0x80000000) q = q->one; else q = q->zero;        // Right branch
-        bits <<= 1;                                                 // Next bit
-        j++;
-        if (8 == j) {                                               // Each 8 bits
-            fread(&a, SYMBOL_SIZE, 1, data->fi);                    // Read 1 byte from file
-            bits |= a;                                              // and insert in bits
-            j = 0;                                                  // No holes
-        }
-        if (!q->one && !q->zero) {                                  // If node is a symbol
-            putc(q->symb, data->fo);                                // write down to the file
-            data->length_in--;                                      // Update remaining length
-            q=data->freql->tree;                                    // Back to the tree's root
-        }
-    } while (data->length_in);                                      // Until file is over
-
-    return 0;
+    if (data->header_flags[1] & HEADER_FLAG_BLOCKS) {
+        return _ah_decode_blocks(data, block_size);
+    }
+    if (data->header_flags[1] & HEADER_FLAG_ADAPTIVE) {
+        return _ah_decode_adaptive(data);
+    }
+    if (data->length_in == 0) return OK;
+    if (!table.length) return INVALID_FILE_IN;
+    decode_table *dtable = (decode_table *)malloc(sizeof(decode_table));
+    if (!dtable) return ERROR_MEM;
+    r = decode_table_build(dtable, &table);
+    if (r) {
+        free(dtable);
+        return r;
+    }
+    if (data->threads > 1 && dtable->max_nbits && !data->range) {
+        // Split the codes between the threads
+        r = spec_decode(dtable, data->fi, data->fo, data->length_in, data->threads);
+        free(dtable);
+        return r;
+    }
+    bitreader br;
+    unsigned char *buffer = (unsigned char *)malloc(WRITE_BUFFER_SIZE);
+    if (!buffer || _ah_bitreader_init(data, &br)) {
+        free(dtable);
+        free(buffer);
+        return ERROR_MEM;
+    }
+    // Decode the symbols in blocks that are written into the output stream
+    // Without blocks, a range is decoded from the start
+    unsigned long remaining = data->length_in;
+    while (remaining && !r && !_ah_after_range(data, data->length_in - remaining)) {
+        size_t n = remaining < WRITE_BUFFER_SIZE ? remaining : WRITE_BUFFER_SIZE;
+        r = codec_decode(dtable, &br, buffer, n);
+        if (!r) r = _ah_write_raw(data, buffer, n, data->length_in - remaining);
+        remaining -= n;
+    }
+    bitreader_free(&br);
+    free(buffer);
+    free(dtable);
+    return r;
 }
 
 /*
@@ -418,5 +1277,6 @@ void ah_fprintf_summary(FILE *f, const ah_data *data) {
     } else {
         fprintf(f, "Ratio (without headers): -\n");
     }
+    fprintf(f, "Counting kernel: %s\n", hist_cpu_name());
     fprintf(f, "===============================================\n");
 }
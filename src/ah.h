@@ -34,15 +34,40 @@ typedef struct _ah_data {
          *filename_out;         /* Output file name with the encoded data */
     FILE *fi,                   /* Input file manager */
          *fo;                   /* Output file manager. */
+    const unsigned char *map;   /* Input file mapped in memory, or NULL
+                                   if it's not mapped (pipes, stdin...) */
+    size_t map_len;             /* Bytes of map */
+    size_t map_pos;             /* Position in map of the next byte to
+                                   read */
     unsigned long length_in;    /* File size in bytes */
     unsigned long length_out;   /* File size in bytes for output, without
                                    taking into account headers (verbose) */
-    unsigned char *buffer_in;   /* Buffer to keep all the content from
-                                   fi (only used when fi = stdin) */
-    unsigned long length_buff;  /* Buffer size in bytes */
+    int stream;                 /* If TRUE the input is read only once,
+                                   counting the symbols of each block
+                                   while it's encoded (fi = stdin) */
+    int counted;                /* If TRUE the symbols were counted by
+                                   ah_count before encoding, otherwise
+                                   ah_encode counts them in each block */
     freqlist *freql;            /* Frequency list of characters */
     int decompres;              /* If TRUE is decompression */
     int verbose;                /* If TRUE the verbose mode is activated */
+    int threads;                /* Number of threads to use */
+    unsigned char max_nbits;    /* Max length of the Huffman codes */
+    int streams;                /* Number of streams the codes of each
+                                   block are split in: 1 or CODEC_STREAMS */
+    int context;                /* If TRUE the blocks are encoded with
+                                   order-1 contexts */
+    int adaptive;               /* If TRUE the adaptive Huffman codes
+                                   are used, encoding in one pass */
+    int fast;                   /* If TRUE the tables are built from
+                                   samples of the input, not counting it
+                                   all (see BLOCK_SAMPLE_SIZE) */
+    int index;                  /* If TRUE a seek index is written after
+                                   the blocks, to decode ranges quickly */
+    int range;                  /* If TRUE only range_length bytes from
+                                   range_offset are decoded */
+    unsigned long range_offset;
+    unsigned long range_length;
     unsigned char               /* Flags to store in the output */
         header_flags[2];        /* header with info about the file */
 } ah_data;
@@ -80,12 +105,23 @@ void ah_data_free_resources(ah_data *data);
 
 
 /*
- * Count the frequencies.
+ * Count the frequencies. If data->stream or data->fast is
+ * TRUE, they are counted later by ah_encode: in fast mode,
+ * only the samples the blocks build their tables from.
  */
 int ah_count(ah_data *data);
 
 /*
- * Encode and write the compressed data.
+ * Build the Huffman codes from the frequencies counted: the
+ * Huffman tree, the code lengths limited to data->max_nbits,
+ * and the canonical codes.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int ah_build_codes(ah_data *data);
+
+/*
+ * Encode and write the compressed data. If the frequencies were
+ * not counted by ah_count, count them from the blocks encoded.
  */
 int ah_encode(ah_data *data);
 
@@ -94,6 +130,20 @@ int ah_encode(ah_data *data);
  */
 int ah_decode(ah_data *data);
 
+/*
+ * Check the two bytes of flags of a header: the version of the
+ * format and the flags of the second byte.
+ * Return 0 if they are supported, otherwise INVALID_FILE_IN.
+ */
+int ah_check_header_flags(const unsigned char flags[2]);
+
+/*
+ * Return a message that describes the error code, to print it
+ * or log it. The codec functions never end the process, they
+ * return these codes.
+ */
+const char *ah_strerror(int error_code);
+
 /*
  * Return the number of bytes to use to
  * record a code of nbits.
@@ -0,0 +1,45 @@
+/* aio.c
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+
+#include "const.h"
+#include "aio.h"
+
+
+/*
+ * Start to run fn(arg) in its own thread, or run it
+ * in the current thread if it can't be created.
+ */
+void aio_start(aio_task *t, void *(*fn)(void *), void *arg) {
+    t->started = !pthread_create(&t->thread, NULL, fn, arg);
+    if (!t->started) {
+        fn(arg);
+    }
+}
+
+/*
+ * Wait until the task started with aio_start ends.
+ */
+void aio_wait(aio_task *t) {
+    if (t->started) {
+        pthread_join(t->thread, NULL);
+        t->started = FALSE;
+    }
+}
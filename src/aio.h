@@ -0,0 +1,53 @@
+/* aio.h
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+
+#ifndef __AH_AIO_H
+#define __AH_AIO_H
+
+
+#include <pthread.h>
+
+
+/*
+ * A task that reads or writes in its own thread, while the
+ * current thread encodes or decodes, so the I/O and the CPU
+ * work at the same time. If the thread can't be created, the
+ * task is run in the current thread, without the overlap.
+ */
+typedef struct _aio_task {
+    pthread_t thread;
+    int started;                /* TRUE if the task runs in its thread */
+} aio_task;
+
+
+/*
+ * Start to run fn(arg) in its own thread, or run it
+ * in the current thread if it can't be created.
+ */
+void aio_start(aio_task *t, void *(*fn)(void *), void *arg);
+
+/*
+ * Wait until the task started with aio_start ends.
+ */
+void aio_wait(aio_task *t);
+
+
+#endif /* __AH_AIO_H */
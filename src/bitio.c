@@ -0,0 +1,204 @@
+/* bitio.c
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "const.h"
+#include "bitio.h"
+
+
+/*
+ * Initialize the writer, with an output buffer of size bytes
+ * (plus BITIO_SLACK bytes), that is written into fo when full.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int bitwriter_init(bitwriter *bw, size_t size, FILE *fo) {
+    bitwriter_init_mem(bw, NULL, size);
+    bw->own = (unsigned char *) malloc(size + BITIO_SLACK);
+    if (!bw->own) {
+        return ERROR_MEM;
+    }
+    bw->buf = bw->own;
+    bw->fo = fo;
+    return OK;
+}
+
+/*
+ * Initialize the writer, to write into buf, that has to have
+ * room for size bytes plus BITIO_SLACK bytes. The writer does
+ * not check the size, so it has to be enough for all the codes.
+ */
+void bitwriter_init_mem(bitwriter *bw, unsigned char *buf, size_t size) {
+    bw->acc = 0;
+    bw->nbits = 0;
+    bw->buf = buf;
+    bw->own = NULL;
+    bw->pos = 0;
+    bw->size = size;
+    bw->fo = NULL;
+    bw->length = 0;
+    bw->error = OK;
+}
+
+/*
+ * Free the buffer of the writer, if any.
+ */
+void bitwriter_free(bitwriter *bw) {
+    free(bw->own);
+    bw->own = NULL;
+}
+
+/* Write the buffer into the file */
+void _bitwriter_write(bitwriter *bw) {
+    if (bw->fo && bw->pos) {
+        if (fwrite(bw->buf, 1, bw->pos, bw->fo) != bw->pos) {
+            bw->error = ERROR_FILE_OUT;
+        }
+        bw->pos = 0;
+    }
+}
+
+/*
+ * Store the whole bytes in the accumulator into the buffer,
+ * writing the buffer into the file if needed.
+ */
+void bitwriter_flush_bytes(bitwriter *bw) {
+    if (bw->nbits >= 8) {
+        // The whole word is stored, but only the complete bytes are counted
+        bitio_store_be64(bw->buf + bw->pos, bw->acc << (64 - bw->nbits));
+        int n = bw->nbits >> 3;
+        bw->pos += n;
+        bw->length += n;
+        bw->nbits &= 7;
+    }
+    if (bw->pos >= bw->size) {
+        _bitwriter_write(bw);
+    }
+}
+
+/*
+ * Store the whole bytes in the accumulator into the buffer, and
+ * write the buffer into the file. The bits of the last byte, if
+ * it's not complete, are kept in the accumulator.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int bitwriter_flush(bitwriter *bw) {
+    bitwriter_flush_bytes(bw);
+    _bitwriter_write(bw);
+    return bw->error;
+}
+
+/*
+ * Write the pending bits, padding the last byte with 0s, and
+ * write the buffer into the file.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int bitwriter_finish(bitwriter *bw) {
+    bitwriter_flush_bytes(bw);
+    if (bw->nbits > 0) {
+        bw->buf[bw->pos++] = (unsigned char) (bw->acc << (8 - bw->nbits));
+        bw->length++;
+        bw->nbits = 0;
+    }
+    _bitwriter_write(bw);
+    return bw->error;
+}
+
+/*
+ * Add code with len bits (len <= 64) to the writer.
+ */
+void bitwriter_put_long(bitwriter *bw, uint64_t code, int len) {
+    if (len > 32) {
+        bitwriter_put(bw, code >> 32, len - 32);
+        len = 32;
+        code &= 0xFFFFFFFFUL;
+    }
+    bitwriter_put(bw, code, len);
+}
+
+
+/*
+ * Initialize the reader, to read from fi with
+ * a buffer of size bytes.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int bitreader_init(bitreader *br, size_t size, FILE *fi) {
+    bitreader_init_mem(br, NULL, 0);
+    br->own = (unsigned char *) malloc(size);
+    if (!br->own) {
+        return ERROR_MEM;
+    }
+    br->buf = br->own;
+    br->size = size;
+    br->fi = fi;
+    return OK;
+}
+
+/*
+ * Initialize the reader, to read the first len bytes of buf.
+ */
+void bitreader_init_mem(bitreader *br, const unsigned char *buf, size_t len) {
+    br->acc = 0;
+    br->nbits = 0;
+    br->buf = buf;
+    br->pos = 0;
+    br->len = len;
+    br->zeros = 0;
+    br->own = NULL;
+    br->size = 0;
+    br->fi = NULL;
+}
+
+/*
+ * Free the buffer of the reader, if any.
+ */
+void bitreader_free(bitreader *br) {
+    free(br->own);
+    br->own = NULL;
+}
+
+/*
+ * Load bytes into the accumulator until it has at least 56 bits,
+ * reading more from the file if needed.
+ */
+void bitreader_refill_slow(bitreader *br) {
+    if (br->fi && br->len - br->pos < BITIO_SLACK) {
+        // Keep the bytes not loaded yet, and fill the rest of the buffer
+        size_t rest = br->len - br->pos;
+        memmove(br->own, br->own + br->pos, rest);
+        br->pos = 0;
+        br->len = rest + fread(br->own + rest, 1, br->size - rest, br->fi);
+        if (br->len < br->size) {
+            br->fi = NULL;      // EOF, nothing more to read
+        }
+    }
+    if (br->pos + 8 <= br->len) {
+        bitreader_refill(br);
+        return;
+    }
+    while (br->nbits <= 56) {
+        if (br->pos < br->len) {
+            br->acc |= (uint64_t) br->buf[br->pos++] << (56 - br->nbits);
+        } else {
+            br->zeros++;        // After the end, 0s are loaded
+        }
+        br->nbits += 8;
+    }
+}
@@ -0,0 +1,226 @@
+/* bitio.h
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef __AH_BITIO_H
+#define __AH_BITIO_H
+
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define BITIO_MAX_PUT       57      /* Max bits that can be added at once
+                                       with bitwriter_put */
+#define BITIO_SLACK         8       /* Bytes at the end of the buffers that
+                                       have to be available to store or load
+                                       a whole word */
+
+
+/*
+ * Write codes of variable length, from the most significant
+ * bit to the least significant, into a memory buffer that is
+ * written into a file each time it gets full.
+ */
+typedef struct _bitwriter {
+    uint64_t acc;               /* Bits pending to store in buf,
+                                   aligned to the right */
+    int nbits;                  /* Number of bits in acc */
+    unsigned char *buf;         /* Output buffer */
+    unsigned char *own;         /* Buffer allocated by the writer
+                                   (buf = own), or NULL */
+    size_t pos;                 /* Bytes stored in buf */
+    size_t size;                /* Size of buf, without the slack */
+    FILE *fo;                   /* File where buf is written when full, or
+                                   NULL to only write in memory */
+    unsigned long length;       /* Total bytes written, including the
+                                   bytes in buf */
+    int error;                  /* Error code, 0 if no errors */
+} bitwriter;
+
+
+/*
+ * Read codes of variable length, from the most significant bit to
+ * the least significant, from a memory buffer, that is filled from
+ * a file each time it is consumed. Reading after the end of the
+ * input returns 0s.
+ */
+typedef struct _bitreader {
+    uint64_t acc;               /* Bits read and not consumed yet,
+                                   aligned to the left */
+    int nbits;                  /* Number of bits in acc */
+    const unsigned char *buf;   /* Input buffer */
+    size_t pos;                 /* Bytes of buf already loaded in acc */
+    size_t len;                 /* Bytes available in buf */
+    size_t zeros;               /* Bytes of 0s loaded after the end */
+    unsigned char *own;         /* Buffer allocated by the reader to
+                                   read from fi (buf = own), or NULL */
+    size_t size;                /* Size of own */
+    FILE *fi;                   /* File to read when buf is consumed,
+                                   or NULL if the input is only buf */
+} bitreader;
+
+
+/*
+ * Initialize the writer, with an output buffer of size bytes
+ * (plus BITIO_SLACK bytes), that is written into fo when full.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int bitwriter_init(bitwriter *bw, size_t size, FILE *fo);
+
+/*
+ * Initialize the writer, to write into buf, that has to have
+ * room for size bytes plus BITIO_SLACK bytes. The writer does
+ * not check the size, so it has to be enough for all the codes.
+ */
+void bitwriter_init_mem(bitwriter *bw, unsigned char *buf, size_t size);
+
+/*
+ * Free the buffer of the writer, if any.
+ */
+void bitwriter_free(bitwriter *bw);
+
+/*
+ * Store the whole bytes in the accumulator into the buffer,
+ * writing the buffer into the file if needed.
+ */
+void bitwriter_flush_bytes(bitwriter *bw);
+
+/*
+ * Store the whole bytes in the accumulator into the buffer, and
+ * write the buffer into the file. The bits of the last byte, if
+ * it's not complete, are kept in the accumulator.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int bitwriter_flush(bitwriter *bw);
+
+/*
+ * Write the pending bits, padding the last byte with 0s, and
+ * write the buffer into the file.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int bitwriter_finish(bitwriter *bw);
+
+/*
+ * Add code with len bits (len <= 64) to the writer.
+ */
+void bitwriter_put_long(bitwriter *bw, uint64_t code, int len);
+
+/*
+ * Initialize the reader, to read from fi with
+ * a buffer of size bytes.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int bitreader_init(bitreader *br, size_t size, FILE *fi);
+
+/*
+ * Initialize the reader, to read the first len bytes of buf.
+ */
+void bitreader_init_mem(bitreader *br, const unsigned char *buf, size_t len);
+
+/*
+ * Free the buffer of the reader, if any.
+ */
+void bitreader_free(bitreader *br);
+
+/*
+ * Load bytes into the accumulator until it has at least 56 bits,
+ * reading more from the file if needed.
+ */
+void bitreader_refill_slow(bitreader *br);
+
+
+/* Store w in big-endian order in p */
+static inline void bitio_store_be64(unsigned char *p, uint64_t w) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    w = __builtin_bswap64(w);
+    __builtin_memcpy(p, &w, 8);
+#else
+    for (int i = 7; i >= 0; i--) {
+        p[i] = (unsigned char) w;
+        w >>= 8;
+    }
+#endif
+}
+
+/* Load a big-endian 64-bit word from p */
+static inline uint64_t bitio_load_be64(const unsigned char *p) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t w;
+    __builtin_memcpy(&w, p, 8);
+    return __builtin_bswap64(w);
+#else
+    uint64_t w = 0;
+    for (int i = 0; i < 8; i++) {
+        w = (w << 8) | p[i];
+    }
+    return w;
+#endif
+}
+
+/*
+ * Add code with len bits (len <= BITIO_MAX_PUT) to the writer.
+ */
+static inline void bitwriter_put(bitwriter *bw, uint64_t code, int len) {
+    if (bw->nbits + len > 64) {
+        bitwriter_flush_bytes(bw);
+    }
+    bw->acc = (bw->acc << len) | code;
+    bw->nbits += len;
+}
+
+/*
+ * Load bytes into the accumulator until it has at least 56 bits.
+ */
+static inline void bitreader_refill(bitreader *br) {
+    if (br->pos + 8 <= br->len) {
+        br->acc |= bitio_load_be64(br->buf + br->pos) >> br->nbits;
+        br->pos += (63 - br->nbits) >> 3;
+        br->nbits |= 56;
+    } else {
+        bitreader_refill_slow(br);
+    }
+}
+
+/*
+ * Return the position in bits of the next bit to
+ * consume, from the start of the buffer.
+ */
+static inline uint64_t bitreader_tell(const bitreader *br) {
+    return (uint64_t) (br->pos + br->zeros) * 8 - br->nbits;
+}
+
+/*
+ * Return the next n bits (0 < n <= nbits) without consuming them.
+ */
+static inline uint64_t bitreader_peek(const bitreader *br, int n) {
+    return br->acc >> (64 - n);
+}
+
+/*
+ * Consume n bits (n <= nbits).
+ */
+static inline void bitreader_skip(bitreader *br, int n) {
+    br->acc <<= n;
+    br->nbits -= n;
+}
+
+
+#endif /* __AH_BITIO_H */
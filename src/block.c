@@ -0,0 +1,544 @@
+/* block.c
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "const.h"
+#include "block.h"
+#include "freqlist.h"
+#include "hist.h"
+
+
+/*
+ * Initialize the block, without buffers.
+ */
+void block_init(block *b) {
+    b->in = NULL;
+    b->len_in = 0;
+    b->own_in = NULL;
+    b->size_in = 0;
+    b->out = NULL;
+    b->len_out = 0;
+    b->size_out = 0;
+    b->len_table = 0;
+    b->stored = FALSE;
+    b->fast = FALSE;
+    b->max_nbits = MAX_CODE_NBITS;
+    b->streams = 1;
+    b->context = FALSE;
+    b->context_hist = NULL;
+    b->context_tables = NULL;
+    b->error = OK;
+}
+
+/*
+ * Free the buffers of the block.
+ */
+void block_free(block *b) {
+    free(b->own_in);
+    free(b->out);
+    free(b->context_hist);
+    free(b->context_tables);
+    b->own_in = b->out = NULL;
+    b->size_in = b->size_out = 0;
+    b->context_hist = NULL;
+    b->context_tables = NULL;
+}
+
+/* Allocate the tables of the contexts, kept by the block for the next ones */
+int _block_reserve_context(block *b, int count) {
+    if (count && !b->context_hist) {
+        b->context_hist = calloc(HIST_SYMBOLS, sizeof(*b->context_hist));
+        if (!b->context_hist) return ERROR_MEM;
+    }
+    if (!b->context_tables) {
+        b->context_tables = (code_table *) malloc(HIST_SYMBOLS * sizeof(code_table));
+        if (!b->context_tables) return ERROR_MEM;
+    }
+    return OK;
+}
+
+/*
+ * Make room in the buffer *buf of *size bytes for at
+ * least len bytes, growing it if needed.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_reserve(unsigned char **buf, size_t *size, size_t len) {
+    if (*size >= len) {
+        return OK;
+    }
+    unsigned char *p = (unsigned char *) realloc(*buf, len);
+    if (!p) {
+        return ERROR_MEM;
+    }
+    *buf = p;
+    *size = len;
+    return OK;
+}
+
+/*
+ * Return the max length of the encoded data of a block of len
+ * bytes: with the largest tables, and all the codes of the max
+ * length that can be decoded.
+ */
+size_t block_max_encoded(size_t len) {
+    return BLOCK_CONTEXT_MAP_SIZE + HIST_SYMBOLS * CODE_TABLE_MAX_SIZE
+           + (CODEC_STREAMS - 1) * COUNT_SIZE + CODEC_STREAMS
+           + (len * DECODE_MAX_NBITS + 7) / 8;
+}
+
+/* Build the canonical codes of the symbols counted in hist */
+int _block_build_codes(code_table *t, const uint64_t hist[HIST_SYMBOLS],
+                       unsigned char max_nbits) {
+    // The nodes of the list in the stack, nothing is allocated
+    freqlist l;
+    node_freqlist nodes[HIST_SYMBOLS];
+    freqlist_init_hist(&l, nodes, hist);
+    freqlist_sort(&l);
+    int r = freqlist_build_huff(&l);
+    if (!r) {
+        freqlist_limit_nbits(&l, max_nbits);
+        freqlist_canonical(&l);
+        r = code_table_build(t, &l);
+    }
+    return r;
+}
+
+/* Store the input of the block as is, without table nor codes */
+int _block_store(block *b) {
+    int r = block_reserve(&b->out, &b->size_out, b->len_in);
+    if (r) return r;
+    memcpy(b->out, b->in, b->len_in);
+    b->len_out = b->len_in;
+    b->len_table = 0;
+    b->stored = TRUE;
+    return OK;
+}
+
+/* Split len symbols in the segments of the streams */
+void _block_segments(size_t len, int streams, size_t n[CODEC_STREAMS]) {
+    size_t segment = (len + streams - 1) / streams;
+    for (int j = 0; j < streams; j++) {
+        n[j] = len < segment ? len : segment;
+        len -= n[j];
+    }
+}
+
+/*
+ * Count in hist a sample of the len bytes of in: BLOCK_SAMPLE_SIZE
+ * bytes of each BLOCK_SAMPLE_STRIDE bytes.
+ * Return the number of bytes counted.
+ */
+size_t _block_count_sample(uint64_t hist[HIST_SYMBOLS], const unsigned char *in, size_t len) {
+    size_t counted = 0;
+    for (size_t i = 0; i < len; i += BLOCK_SAMPLE_STRIDE) {
+        size_t n = len - i < BLOCK_SAMPLE_SIZE ? len - i : BLOCK_SAMPLE_SIZE;
+        hist_count(hist, in + i, n);
+        counted += n;
+    }
+    return counted;
+}
+
+/*
+ * First step to encode the input of the block: count the symbols,
+ * build the table with codes of b->max_nbits bits at most, and
+ * write the table in the output of the block, with room for the
+ * codes, that are written by block_encode_codes.
+ * If b->fast is TRUE only a sample of the input is counted, and
+ * the symbols not found in the sample get a code too.
+ * If the table and the codes would not be smaller than the input,
+ * the input is stored instead (see block.stored).
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_encode_table(block *b) {
+    b->stored = FALSE;
+    size_t n[CODEC_STREAMS];
+    uint64_t hist[CODEC_STREAMS][HIST_SYMBOLS];
+    _block_segments(b->len_in, b->streams, n);
+    const unsigned char *in = b->in;
+    size_t counted = 0;
+    hist_clear(b->hist);
+    for (int j = 0; j < b->streams; in += n[j++]) {
+        hist_clear(hist[j]);
+        if (b->fast) {
+            counted += _block_count_sample(hist[j], in, n[j]);
+        } else {
+            hist_count(hist[j], in, n[j]);
+        }
+        hist_merge(b->hist, hist[j]);
+    }
+    int r;
+    size_t len = 0;
+    if (b->fast) {
+        // Escape of the symbols not sampled: all the symbols have a code
+        uint64_t h[HIST_SYMBOLS];
+        for (int c = 0; c < HIST_SYMBOLS; c++) {
+            h[c] = b->hist[c] ? b->hist[c] : 1;
+        }
+        r = _block_build_codes(&b->table, h, b->max_nbits);
+        if (r) return r;
+        // The size of the codes is estimated from the sample,
+        // and the buffer has room for the longest codes
+        uint64_t estimated = code_table_encoded_nbits(&b->table, b->hist) / 8
+                             * b->len_in / counted;
+        if (CODE_TABLE_MAX_SIZE + estimated >= b->len_in) {
+            return _block_store(b);
+        }
+        for (int j = 0; j < b->streams; j++) {
+            b->len_codes[j] = (n[j] * b->table.max_nbits + 7) / 8;
+            len += b->len_codes[j];
+        }
+    } else {
+        r = _block_build_codes(&b->table, b->hist, b->max_nbits);
+        if (r) return r;
+        // The exact size of the codes is known, so the buffer never gets full
+        for (int j = 0; j < b->streams; j++) {
+            b->len_codes[j] = (code_table_encoded_nbits(&b->table, hist[j]) + 7) / 8;
+            len += b->len_codes[j];
+        }
+    }
+    r = block_reserve(&b->out, &b->size_out, CODE_TABLE_MAX_SIZE
+                      + (CODEC_STREAMS - 1) * COUNT_SIZE + len + BITIO_SLACK);
+    if (r) return r;
+    b->len_table = code_table_write(&b->table, b->out);
+    if (b->len_table + (b->streams - 1) * COUNT_SIZE + len >= b->len_in && !b->fast) {
+        return _block_store(b);
+    }
+    // The length of each stream but the last one is written with the codes
+    b->len_out = b->len_table + (b->streams - 1) * COUNT_SIZE;
+    return OK;
+}
+
+/*
+ * Second step to encode the input of the block, after
+ * block_encode_table: write the codes of the symbols
+ * in the output of the block, after the table.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_encode_codes(block *b) {
+    if (b->stored) {
+        return OK;
+    }
+    size_t n[CODEC_STREAMS];
+    _block_segments(b->len_in, b->streams, n);
+    const unsigned char *in = b->in;
+    int r = OK;
+    for (int j = 0; j < b->streams && !r; in += n[j++]) {
+        bitwriter bw;
+        bitwriter_init_mem(&bw, b->out + b->len_out, b->len_codes[j]);
+        codec_encode(&b->table, in, n[j], &bw);
+        r = bitwriter_finish(&bw);
+        b->len_out += bw.length;
+        if (j < b->streams - 1) {
+            unsigned int len_stream = bw.length;
+            memcpy(b->out + b->len_table + j * COUNT_SIZE, &len_stream, COUNT_SIZE);
+        }
+    }
+    if (!r && b->len_out >= b->len_in) {
+        r = _block_store(b);        // Only with a table of a sample, larger than estimated
+    }
+    return r;
+}
+
+/*
+ * Encode the input of the block: count the symbols, build the
+ * table with codes of b->max_nbits bits at most, and write the
+ * table and the codes in the output of the block.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_encode(block *b) {
+    int r = block_encode_table(b);
+    return r ? r : block_encode_codes(b);
+}
+
+/*
+ * Decode the input of the block into the b->len_out bytes
+ * of the output, using dt to build the decoding table.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_decode(block *b, decode_table *dt) {
+    code_table table;
+    int r = code_table_read(&table, b->in, b->len_in, &b->len_table);
+    if (r) return r;
+    r = decode_table_build(dt, &table);
+    if (r) return r;
+    r = block_reserve(&b->out, &b->size_out, b->len_out);
+    if (r) return r;
+    const unsigned char *p = b->in + b->len_table, *end = b->in + b->len_in;
+    if (b->streams == 1) {
+        bitreader br;
+        bitreader_init_mem(&br, p, end - p);
+        return codec_decode(dt, &br, b->out, b->len_out);
+    }
+    size_t n[CODEC_STREAMS], len_codes[CODEC_STREAMS];
+    _block_segments(b->len_out, b->streams, n);
+    if ((size_t) (end - p) < (CODEC_STREAMS - 1) * COUNT_SIZE) {
+        return INVALID_FILE_IN;
+    }
+    size_t len = 0;
+    for (int j = 0; j < CODEC_STREAMS - 1; j++) {
+        unsigned int len_stream;
+        memcpy(&len_stream, p, COUNT_SIZE);
+        p += COUNT_SIZE;
+        len_codes[j] = len_stream;
+        len += len_stream;
+    }
+    if (len > (size_t) (end - p)) {
+        return INVALID_FILE_IN;
+    }
+    len_codes[CODEC_STREAMS - 1] = (end - p) - len;
+    bitreader br[CODEC_STREAMS];
+    for (int j = 0; j < CODEC_STREAMS; j++) {
+        bitreader_init_mem(&br[j], p, len_codes[j]);
+        p += len_codes[j];
+    }
+    return codec_decode_streams(dt, br, b->out, n);
+}
+
+/*
+ * Decode the input of a stored block, copying it into the output.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_decode_stored(block *b) {
+    if (b->len_in != b->len_out) {
+        return INVALID_FILE_IN;
+    }
+    int r = block_reserve(&b->out, &b->size_out, b->len_out);
+    if (r) return r;
+    memcpy(b->out, b->in, b->len_in);
+    b->len_table = 0;
+    return OK;
+}
+
+/*
+ * Encode the input of the block with order-1 contexts: count
+ * the symbols that follow each symbol, build a table for each
+ * context used, and write the tables and the codes in the output
+ * of the block. The codes have DECODE_TABLE_BITS bits at most.
+ * If the tables and the codes would not be smaller than the input,
+ * the input is stored instead (see block.stored).
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_encode_context(block *b) {
+    b->stored = FALSE;
+    int r = _block_reserve_context(b, TRUE);
+    uint32_t (*hist)[HIST_SYMBOLS] = b->context_hist;
+    code_table *tables = b->context_tables;
+    unsigned char used[BLOCK_CONTEXT_MAP_SIZE];
+    memset(used, 0, sizeof(used));
+    size_t len = 0;
+    int ntables = 0;
+    if (!r) {
+        memset(hist, 0, HIST_SYMBOLS * sizeof(*hist));
+        unsigned char prev = 0;
+        for (size_t i = 0; i < b->len_in; i++) {
+            hist[prev][b->in[i]]++;
+            prev = b->in[i];
+        }
+    }
+    hist_clear(b->hist);
+    unsigned char max_nbits = b->max_nbits < DECODE_TABLE_BITS ? b->max_nbits : DECODE_TABLE_BITS;
+    for (int ctx = 0; ctx < HIST_SYMBOLS && !r; ctx++) {
+        uint64_t h[HIST_SYMBOLS];
+        uint64_t n = 0;
+        for (int c = 0; c < HIST_SYMBOLS; c++) {
+            n += h[c] = hist[ctx][c];
+        }
+        if (!n) continue;
+        hist_merge(b->hist, h);
+        used[ctx >> 3] |= 1 << (ctx & 7);
+        ntables++;
+        r = _block_build_codes(&tables[ctx], h, max_nbits);
+        len += code_table_encoded_nbits(&tables[ctx], h);
+    }
+    if (!r) {
+        // The exact size of the codes is known, so the buffer never gets full
+        len = (len + 7) / 8;
+        r = block_reserve(&b->out, &b->size_out, BLOCK_CONTEXT_MAP_SIZE
+                          + ntables * CODE_TABLE_MAX_SIZE + len + BITIO_SLACK);
+    }
+    if (!r) {
+        memcpy(b->out, used, BLOCK_CONTEXT_MAP_SIZE);
+        b->len_table = BLOCK_CONTEXT_MAP_SIZE;
+        for (int ctx = 0; ctx < HIST_SYMBOLS; ctx++) {
+            if (used[ctx >> 3] & (1 << (ctx & 7))) {
+                b->len_table += code_table_write(&tables[ctx], b->out + b->len_table);
+            }
+        }
+    }
+    if (!r && b->len_table + len >= b->len_in) {
+        r = _block_store(b);
+    } else if (!r) {
+        bitwriter bw;
+        bitwriter_init_mem(&bw, b->out + b->len_table, len);
+        codec_encode_context(tables, b->in, b->len_in, &bw);
+        r = bitwriter_finish(&bw);
+        b->len_out = b->len_table + bw.length;
+    }
+    return r;
+}
+
+/*
+ * Decode the input of the block encoded with order-1 contexts
+ * into the b->len_out bytes of the output, using dt to build
+ * the decoding tables.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_decode_context(block *b, decode_context_table *dt) {
+    if (b->len_in < BLOCK_CONTEXT_MAP_SIZE) {
+        return INVALID_FILE_IN;
+    }
+    int r = _block_reserve_context(b, FALSE);
+    if (r) return r;
+    code_table *tables = b->context_tables;
+    const unsigned char *used = b->in;
+    b->len_table = BLOCK_CONTEXT_MAP_SIZE;
+    for (int ctx = 0; ctx < HIST_SYMBOLS && !r; ctx++) {
+        if (used[ctx >> 3] & (1 << (ctx & 7))) {
+            size_t n;
+            r = code_table_read(&tables[ctx], b->in + b->len_table,
+                                b->len_in - b->len_table, &n);
+            b->len_table += n;
+        }
+    }
+    if (!r) r = decode_context_table_build(dt, tables, used);
+    if (!r) r = block_reserve(&b->out, &b->size_out, b->len_out);
+    if (r) return r;
+    bitreader br;
+    bitreader_init_mem(&br, b->in + b->len_table, b->len_in - b->len_table);
+    return codec_decode_context(dt, &br, b->out, b->len_out);
+}
+
+
+/* Blocks processed by a thread: first, first + step, first + 2*step... */
+typedef struct _block_worker {
+    block *blocks;
+    int n, first, step;
+    int decode;
+    decode_table *dt;           /* Tables to decode, allocated when needed */
+    decode_context_table *ct;
+} block_worker;
+
+/* Thread body, encode or decode the blocks of the worker */
+void *_block_work(void *arg) {
+    block_worker *w = (block_worker *) arg;
+    for (int i = w->first; i < w->n; i += w->step) {
+        block *b = &w->blocks[i];
+        if (w->decode && b->stored) {
+            b->error = block_decode_stored(b);
+        } else if (w->decode && b->context) {
+            if (!w->ct && (w->ct = (decode_context_table *) malloc(sizeof(decode_context_table)))) {
+                decode_context_table_init(w->ct);
+            }
+            b->error = w->ct ? block_decode_context(b, w->ct) : ERROR_MEM;
+        } else if (w->decode) {
+            if (!w->dt) w->dt = (decode_table *) malloc(sizeof(decode_table));
+            b->error = w->dt ? block_decode(b, w->dt) : ERROR_MEM;
+        } else {
+            b->error = b->context ? block_encode_context(b) : block_encode(b);
+        }
+    }
+    return NULL;
+}
+
+/* Process the blocks with nthreads threads, the last one the current thread */
+int _block_work_all(block *blocks, int n, int nthreads, int decode, block_tables *bt) {
+    if (nthreads > n) nthreads = n;
+    if (nthreads < 1) nthreads = 1;
+    block_worker workers[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    int started = 0, r = OK;
+    for (int i = 0; i < nthreads; i++) {
+        workers[i].blocks = blocks;
+        workers[i].n = n;
+        workers[i].first = i;
+        workers[i].step = nthreads;
+        workers[i].decode = decode;
+        workers[i].dt = bt ? bt->dt[i] : NULL;
+        workers[i].ct = bt ? bt->ct[i] : NULL;
+        if (i == nthreads - 1) {
+            _block_work(&workers[i]);
+        } else if (pthread_create(&threads[i], NULL, _block_work, &workers[i])) {
+            r = ERROR_THREAD;
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started && i < nthreads - 1; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < started; i++) {
+        if (bt) {
+            // Kept for the next call
+            bt->dt[i] = workers[i].dt;
+            bt->ct[i] = workers[i].ct;
+        } else {
+            free(workers[i].dt);
+            free(workers[i].ct);
+        }
+    }
+    for (int i = 0; i < n && !r; i++) {
+        r = blocks[i].error;
+    }
+    return r;
+}
+
+/*
+ * Encode the n blocks using nthreads threads. The output is
+ * the same with any number of threads.
+ * Return 0 if no errors, otherwise the error code of the
+ * first block that failed.
+ */
+int block_encode_all(block *blocks, int n, int nthreads) {
+    return _block_work_all(blocks, n, nthreads, FALSE, NULL);
+}
+
+/*
+ * Initialize the decoding tables, without allocating them.
+ */
+void block_tables_init(block_tables *bt) {
+    for (int i = 0; i < MAX_THREADS; i++) {
+        bt->dt[i] = NULL;
+        bt->ct[i] = NULL;
+    }
+}
+
+/*
+ * Free the decoding tables allocated.
+ */
+void block_tables_free(block_tables *bt) {
+    for (int i = 0; i < MAX_THREADS; i++) {
+        free(bt->dt[i]);
+        free(bt->ct[i]);
+    }
+    block_tables_init(bt);
+}
+
+/*
+ * Decode the n blocks using nthreads threads, with the decoding
+ * tables of bt, that are allocated when needed, or if bt is NULL
+ * with tables allocated only for this call.
+ * Return 0 if no errors, otherwise the error code of the
+ * first block that failed.
+ */
+int block_decode_all(block *blocks, int n, int nthreads, block_tables *bt) {
+    return _block_work_all(blocks, n, nthreads, TRUE, bt);
+}
@@ -0,0 +1,215 @@
+/* block.h
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef __AH_BLOCK_H
+#define __AH_BLOCK_H
+
+
+#include <stddef.h>
+#include "codec.h"
+#include "const.h"
+#include "hist.h"
+
+
+#define BLOCK_CONTEXT_MAP_SIZE  32      /* Bytes of the bitmap of contexts */
+#define BLOCK_SAMPLE_SIZE       4096    /* Bytes counted of each BLOCK_SAMPLE_STRIDE
+                                           bytes to build the table in fast mode */
+#define BLOCK_SAMPLE_STRIDE     65536
+
+
+/*
+ * A block of the input, that is encoded independently of
+ * the other blocks, with its own Huffman table.
+ *
+ * Encoded, a block has the table stored with code_table_write
+ * followed by the codes of the symbols, padded to a whole byte.
+ * If the codes are split in CODEC_STREAMS streams, the block is
+ * split in the same number of consecutive segments (all with the
+ * same length, except the last one), and the codes of each one are
+ * stored in its own stream, after the table and the length in bytes
+ * of each stream but the last one.
+ * With order-1 contexts, the table is replaced by a bitmap of
+ * BLOCK_CONTEXT_MAP_SIZE bytes with the contexts used (the symbols
+ * followed by other symbol, and the context 0 of the first symbol),
+ * followed by the table of each one of them, and the codes are in
+ * one stream.
+ * A block that would not be smaller encoded is stored as is,
+ * with the same length encoded than raw.
+ */
+typedef struct _block {
+    const unsigned char *in;    /* Input: the raw data to encode, or
+                                   the encoded data to decode */
+    size_t len_in;              /* Bytes in in */
+    unsigned char *own_in;      /* Buffer allocated to hold the input,
+                                   or NULL (not used by the block functions) */
+    size_t size_in;             /* Size of own_in */
+    unsigned char *out;         /* Output: the encoded data, or the raw
+                                   data decoded, allocated by the
+                                   block functions */
+    size_t len_out;             /* Bytes in out. To decode, it has to be
+                                   set before with the raw length */
+    size_t size_out;            /* Size of out */
+    size_t len_table;           /* Bytes of the table in the encoded data */
+    int stored;                 /* If TRUE the block is stored as is,
+                                   without table nor codes. To decode,
+                                   it has to be set before */
+    uint64_t hist[HIST_SYMBOLS];    /* Symbols counted in the input
+                                       (only when encoding) */
+    code_table table;           /* Table of the codes to encode */
+    size_t len_codes[CODEC_STREAMS];    /* Bytes of the codes of
+                                           each stream to encode */
+    unsigned char max_nbits;    /* Max length of the codes to encode */
+    int fast;                   /* If TRUE the table to encode is built
+                                   from a sample of the input */
+    int streams;                /* Number of streams the codes are
+                                   split in: 1 or CODEC_STREAMS */
+    int context;                /* If TRUE the codes are of order-1, with
+                                   a table for each previous symbol */
+    uint32_t (*context_hist)[HIST_SYMBOLS];     /* Symbols counted after each
+                                                   symbol, allocated when needed */
+    code_table *context_tables; /* Table of each context, allocated
+                                   when needed */
+    int error;                  /* Error code, 0 if no errors */
+} block;
+
+/*
+ * Decoding tables of each thread, that can be kept between
+ * calls to block_decode_all to not allocate them each time.
+ */
+typedef struct _block_tables {
+    decode_table *dt[MAX_THREADS];
+    decode_context_table *ct[MAX_THREADS];
+} block_tables;
+
+
+/*
+ * Initialize the block, without buffers.
+ */
+void block_init(block *b);
+
+/*
+ * Free the buffers of the block.
+ */
+void block_free(block *b);
+
+/*
+ * Make room in the buffer *buf of *size bytes for at
+ * least len bytes, growing it if needed.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_reserve(unsigned char **buf, size_t *size, size_t len);
+
+/*
+ * Return the max length of the encoded data of a block of len
+ * bytes: with the largest tables, and all the codes of the max
+ * length that can be decoded.
+ */
+size_t block_max_encoded(size_t len);
+
+/*
+ * First step to encode the input of the block: count the symbols,
+ * build the table with codes of b->max_nbits bits at most, and
+ * write the table in the output of the block, with room for the
+ * codes, that are written by block_encode_codes.
+ * If b->fast is TRUE only a sample of the input is counted, and
+ * the symbols not found in the sample get a code too.
+ * If the table and the codes would not be smaller than the input,
+ * the input is stored instead (see block.stored).
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_encode_table(block *b);
+
+/*
+ * Second step to encode the input of the block, after
+ * block_encode_table: write the codes of the symbols
+ * in the output of the block, after the table.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_encode_codes(block *b);
+
+/*
+ * Encode the input of the block: count the symbols, build the
+ * table with codes of b->max_nbits bits at most, and write the
+ * table and the codes in the output of the block.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_encode(block *b);
+
+/*
+ * Decode the input of the block into the b->len_out bytes
+ * of the output, using dt to build the decoding table.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_decode(block *b, decode_table *dt);
+
+/*
+ * Decode the input of a stored block, copying it into the output.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_decode_stored(block *b);
+
+/*
+ * Encode the input of the block with order-1 contexts: count
+ * the symbols that follow each symbol, build a table for each
+ * context used, and write the tables and the codes in the output
+ * of the block. The codes have DECODE_TABLE_BITS bits at most.
+ * If the tables and the codes would not be smaller than the input,
+ * the input is stored instead (see block.stored).
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_encode_context(block *b);
+
+/*
+ * Decode the input of the block encoded with order-1 contexts
+ * into the b->len_out bytes of the output, using dt to build
+ * the decoding tables.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int block_decode_context(block *b, decode_context_table *dt);
+
+/*
+ * Encode the n blocks using nthreads threads. The output is
+ * the same with any number of threads.
+ * Return 0 if no errors, otherwise the error code of the
+ * first block that failed.
+ */
+int block_encode_all(block *blocks, int n, int nthreads);
+
+/*
+ * Initialize the decoding tables, without allocating them.
+ */
+void block_tables_init(block_tables *bt);
+
+/*
+ * Free the decoding tables allocated.
+ */
+void block_tables_free(block_tables *bt);
+
+/*
+ * Decode the n blocks using nthreads threads, with the decoding
+ * tables of bt, that are allocated when needed, or if bt is NULL
+ * with tables allocated only for this call.
+ * Return 0 if no errors, otherwise the error code of the
+ * first block that failed.
+ */
+int block_decode_all(block *blocks, int n, int nthreads, block_tables *bt);
+
+
+#endif /* __AH_BLOCK_H */
@@ -0,0 +1,577 @@
+/* codec.c
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+#include <string.h>
+#include "const.h"
+#include "codec.h"
+
+
+#if CODEC_STREAMS != 4
+#error "codec_decode_streams decodes 4 streams"
+#endif
+
+
+/*
+ * Build the code table from the codes in the freqlist.
+ * Symbols not in the list have a code of 0 bits.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int code_table_build(code_table *t, const freqlist *l) {
+    memset(t, 0, sizeof(code_table));
+    for (node_freqlist *pnode = l->list; pnode; pnode = pnode->next) {
+        if (pnode->nbits > 64) {
+            return INVALID_BITS_SIZE;
+        }
+        t->codes[pnode->symb].bits = pnode->bits;
+        t->codes[pnode->symb].nbits = pnode->nbits;
+        t->single_symb = pnode->symb;
+        t->length++;
+        if (pnode->nbits > t->max_nbits) {
+            t->max_nbits = pnode->nbits;
+        }
+    }
+    return OK;
+}
+
+/*
+ * Store the code table in out, with the canonical Huffman code
+ * lengths: the number of symbols, the max code length, how many
+ * symbols have each length (except the max length, that has the
+ * rest), and then the symbols sorted by code length and symbol.
+ * The codes have to be the canonical codes (see freqlist_canonical).
+ * out needs at least CODE_TABLE_MAX_SIZE bytes.
+ * Return the number of bytes used.
+ */
+size_t code_table_write(const code_table *t, unsigned char *out) {
+    unsigned char *p = out;
+    // Number of source symbols and the max length of the codes
+    unsigned short int length = t->length;
+    memcpy(p, &length, SMALL_COUNT_SIZE);
+    p += SMALL_COUNT_SIZE;
+    *p++ = t->max_nbits;
+    if (t->max_nbits == 0) {                    // Only one symbol
+        *p++ = t->single_symb;
+        return p - out;
+    }
+    // How many symbols have each code length
+    unsigned char counts[256];
+    memset(counts, 0, sizeof(counts));
+    for (int c = 0; c < 256; c++) {
+        counts[t->codes[c].nbits]++;
+    }
+    memcpy(p, counts + 1, t->max_nbits - 1);
+    p += t->max_nbits - 1;
+    // The symbols in the canonical order
+    for (int nbits = 1; nbits <= t->max_nbits; nbits++) {
+        for (int c = 0; c < 256; c++) {
+            if (t->codes[c].nbits == nbits) {
+                *p++ = c;
+            }
+        }
+    }
+    return p - out;
+}
+
+/*
+ * Read the code table stored with code_table_write from the first
+ * len bytes of in, assigning the canonical codes. The codes have
+ * to be complete: every sequence of bits starts with a code, so the
+ * decoders don't need to check for codes that don't exist. The
+ * number of bytes read is set in used.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int code_table_read(code_table *t, const unsigned char *in, size_t len, size_t *used) {
+    memset(t, 0, sizeof(code_table));
+    unsigned short int length;
+    if (len < SMALL_COUNT_SIZE + 1) {
+        return INVALID_FILE_IN;
+    }
+    memcpy(&length, in, SMALL_COUNT_SIZE);
+    int max_nbits = in[SMALL_COUNT_SIZE];
+    if (length == 0 || length > 256 || (max_nbits == 0 && length != 1)) {
+        return INVALID_FILE_IN;
+    }
+    const unsigned char *p = in + SMALL_COUNT_SIZE + 1, *end = in + len;
+    t->length = length;
+    t->max_nbits = max_nbits;
+    unsigned int counts[256];
+    unsigned int sum = 0;
+    memset(counts, 0, sizeof(counts));
+    if (max_nbits > 0 && end - p < max_nbits - 1) {
+        return INVALID_FILE_IN;
+    }
+    for (int nbits = 1; nbits < max_nbits; nbits++) {
+        counts[nbits] = *p++;
+        sum += counts[nbits];
+    }
+    if (sum >= length && max_nbits > 0) return INVALID_FILE_IN;
+    counts[max_nbits] = length - sum;
+    if (end - p < length) {
+        return INVALID_FILE_IN;
+    }
+    // Assign the codes in order: the codes of each length
+    // follow the last code of the previous length
+    uint64_t code = 0;
+    for (int nbits = max_nbits == 0 ? 0 : 1; nbits <= max_nbits; nbits++) {
+        for (unsigned int i = 0; i < counts[nbits]; i++) {
+            int c = *p++;
+            if (t->codes[c].nbits || (nbits < 64 && code >> nbits)) {
+                return INVALID_FILE_IN;         // Repeated symbol or too many codes
+            }
+            t->codes[c].bits = code++;
+            t->codes[c].nbits = nbits;
+            t->single_symb = c;
+        }
+        code <<= 1;
+    }
+    if (max_nbits > 0 && max_nbits <= DECODE_MAX_NBITS && code != 2ULL << max_nbits) {
+        return INVALID_FILE_IN;                 // Codes missing, not a complete prefix code
+    }
+    *used = p - in;
+    return OK;
+}
+
+/*
+ * Return the number of bits needed to encode the
+ * symbols counted in hist with the code table.
+ */
+uint64_t code_table_encoded_nbits(const code_table *t, const uint64_t hist[256]) {
+    uint64_t nbits = 0;
+    for (int c = 0; c < 256; c++) {
+        nbits += hist[c] * t->codes[c].nbits;
+    }
+    return nbits;
+}
+
+/*
+ * Encode the first len bytes of in, writing their codes into bw.
+ */
+void codec_encode(const code_table *t, const unsigned char *in, size_t len, bitwriter *bw) {
+    const huff_code *codes = t->codes;
+    const unsigned char *end = in + len;
+    if (t->max_nbits > BITIO_MAX_PUT) {
+        while (in < end) {                  // Slow path, codes too long for one put
+            const huff_code *c = &codes[*in++];
+            bitwriter_put_long(bw, c->bits, c->nbits);
+        }
+        return;
+    }
+    while (in < end) {
+        const huff_code *c = &codes[*in++];
+        bitwriter_put(bw, c->bits, c->nbits);
+    }
+}
+
+
+/*
+ * Build the multi-symbol entries from the single symbol entries,
+ * if at least two of the shortest codes fit in the table bits.
+ */
+void _decode_table_build_multi(decode_table *dt) {
+    int min_nbits = dt->bits + 1;
+    for (int i = 0; i < (1 << dt->bits); i++) {
+        if (dt->entries[i].nbits && dt->entries[i].nbits < min_nbits) {
+            min_nbits = dt->entries[i].nbits;
+        }
+    }
+    dt->min_nbits = min_nbits;
+    dt->multi = 2 * min_nbits <= dt->bits;
+    if (!dt->multi) return;
+    const unsigned int mask = (1 << dt->bits) - 1;
+    for (unsigned int i = 0; i <= mask; i++) {
+        decode_multi_entry *m = &dt->multi_entries[i];
+        int used = 0;
+        m->nsymbs = 0;
+        while (m->nsymbs < DECODE_MULTI_SYMBS) {
+            // The bits after the index are unknown, so only codes complete in it
+            decode_entry e = dt->entries[(i << used) & mask];
+            if (!e.nbits || used + e.nbits > dt->bits) break;
+            m->symbs[m->nsymbs++] = e.symb;
+            used += e.nbits;
+        }
+        m->nbits = used;
+    }
+}
+
+/*
+ * Build the decoding table from the code table, that
+ * needs at least one symbol.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int decode_table_build(decode_table *dt, const code_table *t) {
+    memset(dt, 0, sizeof(decode_table));
+    dt->max_nbits = t->max_nbits;
+    dt->single_symb = t->single_symb;
+    if (t->max_nbits > DECODE_MAX_NBITS) {
+        return INVALID_BITS_SIZE;
+    }
+    dt->bits = t->max_nbits < DECODE_TABLE_BITS ? t->max_nbits : DECODE_TABLE_BITS;
+    for (int c = 0; c < 256; c++) {
+        const huff_code *pc = &t->codes[c];
+        if (!pc->nbits) {
+            continue;                       // Not present
+        }
+        uint64_t bits = pc->bits & ((~0ULL) >> (64 - pc->nbits));
+        if (pc->nbits <= dt->bits) {
+            // All the entries that start with the code
+            int shift = dt->bits - pc->nbits;
+            uint64_t first = bits << shift;
+            for (uint64_t i = 0; i < (1ULL << shift); i++) {
+                dt->entries[first + i].symb = c;
+                dt->entries[first + i].nbits = pc->nbits;
+            }
+        } else {
+            // Sorted insert in long_codes by (prefix, nbits)
+            int i = dt->nlong++;
+            uint64_t key = bits << (64 - pc->nbits);
+            while (i > 0) {
+                const huff_code *prev = &dt->long_codes[i-1];
+                uint64_t prev_key = prev->bits << (64 - prev->nbits);
+                if ((prev_key >> (64 - dt->bits)) < (key >> (64 - dt->bits))
+                        || ((prev_key >> (64 - dt->bits)) == (key >> (64 - dt->bits))
+                            && prev->nbits <= pc->nbits)) {
+                    break;
+                }
+                dt->long_codes[i] = dt->long_codes[i-1];
+                dt->long_symbs[i] = dt->long_symbs[i-1];
+                i--;
+            }
+            dt->long_codes[i].bits = bits;
+            dt->long_codes[i].nbits = pc->nbits;
+            dt->long_symbs[i] = c;
+        }
+    }
+    // The prefix entries of the long codes point to the first one with that prefix
+    for (int i = dt->nlong - 1; i >= 0; i--) {
+        const huff_code *pc = &dt->long_codes[i];
+        decode_entry *e = &dt->entries[pc->bits >> (pc->nbits - dt->bits)];
+        e->symb = i;
+        e->nbits = 0;
+    }
+    _decode_table_build_multi(dt);
+    return OK;
+}
+
+/* Slow path, decode a code longer than the table bits */
+int _codec_decode_long(const decode_table *dt, bitreader *br, unsigned char *out) {
+    bitreader_refill(br);
+    uint64_t prefix = bitreader_peek(br, dt->bits);
+    for (int i = dt->entries[prefix].symb; i < dt->nlong; i++) {
+        const huff_code *pc = &dt->long_codes[i];
+        if (pc->bits >> (pc->nbits - dt->bits) != prefix) {
+            break;
+        }
+        if (bitreader_peek(br, pc->nbits) == pc->bits) {
+            *out = dt->long_symbs[i];
+            bitreader_skip(br, pc->nbits);
+            return OK;
+        }
+    }
+    return INVALID_FILE_IN;
+}
+
+/*
+ * Decode n symbols from br into out.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int codec_decode(const decode_table *dt, bitreader *br, unsigned char *out, size_t n) {
+    if (!dt->max_nbits) {
+        memset(out, dt->single_symb, n);
+        return OK;
+    }
+    const decode_entry *entries = dt->entries;
+    const int bits = dt->bits;
+    unsigned char *end = out + n;
+    if (dt->multi) {
+        const decode_multi_entry *multi_entries = dt->multi_entries;
+        // All the symbols of an entry are copied, but only nsymbs are kept
+        while (end - out >= DECODE_MULTI_SYMBS) {
+            bitreader_refill(br);
+            int k = br->nbits / bits;
+            while (k-- && end - out >= DECODE_MULTI_SYMBS) {
+                const decode_multi_entry *m = &multi_entries[bitreader_peek(br, bits)];
+                if (m->nsymbs) {
+                    memcpy(out, m->symbs, DECODE_MULTI_SYMBS);
+                    out += m->nsymbs;
+                    bitreader_skip(br, m->nbits);
+                } else {
+                    if (_codec_decode_long(dt, br, out++)) {
+                        return INVALID_FILE_IN;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+    while (out < end) {
+        bitreader_refill(br);
+        // At least 56 bits available, enough for several codes of the table
+        int k = br->nbits / bits;
+        while (k-- && out < end) {
+            decode_entry e = entries[bitreader_peek(br, bits)];
+            if (e.nbits) {
+                *out++ = e.symb;
+                bitreader_skip(br, e.nbits);
+            } else {
+                if (_codec_decode_long(dt, br, out++)) {
+                    return INVALID_FILE_IN;
+                }
+                break;
+            }
+        }
+    }
+    return OK;
+}
+
+/*
+ * Decode symbols from br into out, until the position of the
+ * reader (see bitreader_tell) is end or after it, or until max_n
+ * symbols are decoded. The position where each one of the first
+ * nbounds symbols starts is stored in bounds (NULL if nbounds is 0).
+ * The number of symbols decoded is set in n, also if the input
+ * is invalid. The table needs codes of at least one bit.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int codec_decode_until(const decode_table *dt, bitreader *br, unsigned char *out,
+                       size_t max_n, uint64_t end, uint64_t *bounds, size_t nbounds,
+                       size_t *n) {
+    const decode_entry *entries = dt->entries;
+    const int bits = dt->bits;
+    size_t i = 0;
+    int r = OK;
+    while (i < max_n && bitreader_tell(br) < end && !r) {
+        bitreader_refill(br);
+        int k = br->nbits / bits;
+        while (k-- && i < max_n) {
+            uint64_t pos = bitreader_tell(br);
+            if (pos >= end) break;
+            if (i < nbounds) bounds[i] = pos;
+            decode_entry e = entries[bitreader_peek(br, bits)];
+            if (e.nbits) {
+                out[i++] = e.symb;
+                bitreader_skip(br, e.nbits);
+            } else {
+                r = _codec_decode_long(dt, br, out + i);
+                if (!r) i++;
+                break;
+            }
+        }
+    }
+    *n = i;
+    return r;
+}
+
+/*
+ * Encode the first len bytes of in with order-1 contexts, writing
+ * the code of each byte with the table of the byte before it (the
+ * table of the context 0 for the first one) into bw. The codes
+ * have to be of DECODE_TABLE_BITS bits at most.
+ */
+void codec_encode_context(const code_table tables[256], const unsigned char *in,
+                          size_t len, bitwriter *bw) {
+    const unsigned char *end = in + len;
+    unsigned char prev = 0;
+    while (in < end) {
+        const huff_code *c = &tables[prev].codes[*in];
+        bitwriter_put(bw, c->bits, c->nbits);
+        prev = *in++;
+    }
+}
+
+/* Clear the table of the context, without codes */
+void _decode_context_clear(decode_context_table *dt, int ctx) {
+    for (int i = 0; i < (1 << DECODE_TABLE_BITS); i++) {
+        dt->entries[ctx][i].symb = 0;
+        dt->entries[ctx][i].nbits = DECODE_CONTEXT_INVALID;
+    }
+    dt->used[ctx] = FALSE;
+}
+
+/*
+ * Initialize the context tables, without codes.
+ */
+void decode_context_table_init(decode_context_table *dt) {
+    for (int ctx = 0; ctx < 256; ctx++) {
+        _decode_context_clear(dt, ctx);
+    }
+}
+
+/*
+ * Build the decoding table of each context from the code table in
+ * tables, if the context is used in the bitmap used, or clear it if not.
+ * The tables that are the same than in the previous call are kept.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int decode_context_table_build(decode_context_table *dt, const code_table tables[256],
+                               const unsigned char used[32]) {
+    for (int ctx = 0; ctx < 256; ctx++) {
+        if (!(used[ctx >> 3] & (1 << (ctx & 7)))) {
+            if (dt->used[ctx]) _decode_context_clear(dt, ctx);
+            continue;
+        }
+        const code_table *t = &tables[ctx];
+        if (t->max_nbits > DECODE_TABLE_BITS) {
+            return INVALID_BITS_SIZE;
+        }
+        unsigned char nbits[256];
+        unsigned long kraft = 0;
+        for (int c = 0; c < 256; c++) {
+            nbits[c] = t->codes[c].nbits;
+            if (nbits[c] || (!t->max_nbits && c == t->single_symb)) {
+                kraft += 1UL << (DECODE_TABLE_BITS - nbits[c]);
+            }
+        }
+        if (dt->used[ctx] && memcmp(dt->nbits[ctx], nbits, 256) == 0
+                && (t->max_nbits || dt->single_symb[ctx] == t->single_symb)) {
+            continue;                       // The same canonical codes
+        }
+        if (dt->used[ctx] && kraft < (1UL << DECODE_TABLE_BITS)) {
+            _decode_context_clear(dt, ctx); // Not all the entries have a code
+        }
+        memcpy(dt->nbits[ctx], nbits, 256);
+        dt->single_symb[ctx] = t->single_symb;
+        decode_entry *entries = dt->entries[ctx];
+        for (int c = 0; c < 256; c++) {
+            const huff_code *pc = &t->codes[c];
+            if (!pc->nbits && (t->max_nbits || c != t->single_symb)) {
+                continue;                   // Not present
+            }
+            // All the entries that start with the code
+            int shift = DECODE_TABLE_BITS - pc->nbits;
+            uint64_t first = pc->bits << shift;
+            for (uint64_t i = 0; i < (1ULL << shift); i++) {
+                entries[first + i].symb = c;
+                entries[first + i].nbits = pc->nbits;
+            }
+        }
+        dt->used[ctx] = TRUE;
+    }
+    return OK;
+}
+
+/*
+ * Decode n symbols encoded with codec_encode_context from br into out.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int codec_decode_context(const decode_context_table *dt, bitreader *br,
+                         unsigned char *out, size_t n) {
+    unsigned char *end = out + n;
+    unsigned char prev = 0;
+    while (out < end) {
+        bitreader_refill(br);
+        // At least 56 bits available, enough for 4 codes
+        for (int k = 0; k < 56 / DECODE_TABLE_BITS && out < end; k++) {
+            decode_entry e = dt->entries[prev][bitreader_peek(br, DECODE_TABLE_BITS)];
+            if (e.nbits == DECODE_CONTEXT_INVALID) {
+                return INVALID_FILE_IN;
+            }
+            *out++ = prev = e.symb;
+            bitreader_skip(br, e.nbits);
+        }
+    }
+    return OK;
+}
+
+/*
+ * Decode CODEC_STREAMS independent streams of codes, each one from
+ * its reader in br, into the consecutive segments of out of n[i]
+ * symbols each. The streams are decoded at once in the same loop,
+ * so the decoding of each stream does not wait for the others.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int codec_decode_streams(const decode_table *dt, bitreader br[CODEC_STREAMS],
+                         unsigned char *out, const size_t n[CODEC_STREAMS]) {
+    unsigned char *o[CODEC_STREAMS], *end[CODEC_STREAMS];
+    for (int j = 0; j < CODEC_STREAMS; j++) {
+        o[j] = j ? end[j-1] : out;
+        end[j] = o[j] + n[j];
+    }
+    if (dt->max_nbits && !dt->nlong) {
+        // All the codes are in the table. After a refill each reader
+        // has at least 56 bits, enough for k lookups
+        const int bits = dt->bits;
+        const size_t k = 56 / bits;
+        bitreader b0 = br[0], b1 = br[1], b2 = br[2], b3 = br[3];
+        unsigned char *o0 = o[0], *o1 = o[1], *o2 = o[2], *o3 = o[3];
+        if (3 * dt->min_nbits <= bits) {
+            // Up to DECODE_MULTI_SYMBS symbols by lookup, only worth with 4
+            // streams if at least 3 of the shortest codes fit in the table bits
+            const decode_multi_entry *multi_entries = dt->multi_entries;
+            const size_t room = k * DECODE_MULTI_SYMBS;
+            while ((size_t) (end[0] - o0) >= room && (size_t) (end[1] - o1) >= room
+                    && (size_t) (end[2] - o2) >= room && (size_t) (end[3] - o3) >= room) {
+                bitreader_refill(&b0);
+                bitreader_refill(&b1);
+                bitreader_refill(&b2);
+                bitreader_refill(&b3);
+                for (size_t i = 0; i < k; i++) {
+                    const decode_multi_entry *m0 = &multi_entries[bitreader_peek(&b0, bits)];
+                    const decode_multi_entry *m1 = &multi_entries[bitreader_peek(&b1, bits)];
+                    const decode_multi_entry *m2 = &multi_entries[bitreader_peek(&b2, bits)];
+                    const decode_multi_entry *m3 = &multi_entries[bitreader_peek(&b3, bits)];
+                    bitreader_skip(&b0, m0->nbits);
+                    bitreader_skip(&b1, m1->nbits);
+                    bitreader_skip(&b2, m2->nbits);
+                    bitreader_skip(&b3, m3->nbits);
+                    memcpy(o0, m0->symbs, DECODE_MULTI_SYMBS);
+                    memcpy(o1, m1->symbs, DECODE_MULTI_SYMBS);
+                    memcpy(o2, m2->symbs, DECODE_MULTI_SYMBS);
+                    memcpy(o3, m3->symbs, DECODE_MULTI_SYMBS);
+                    o0 += m0->nsymbs;
+                    o1 += m1->nsymbs;
+                    o2 += m2->nsymbs;
+                    o3 += m3->nsymbs;
+                }
+            }
+        } else {
+            const decode_entry *entries = dt->entries;
+            while ((size_t) (end[0] - o0) >= k && (size_t) (end[1] - o1) >= k
+                    && (size_t) (end[2] - o2) >= k && (size_t) (end[3] - o3) >= k) {
+                bitreader_refill(&b0);
+                bitreader_refill(&b1);
+                bitreader_refill(&b2);
+                bitreader_refill(&b3);
+                for (size_t i = 0; i < k; i++) {
+                    decode_entry e0 = entries[bitreader_peek(&b0, bits)];
+                    decode_entry e1 = entries[bitreader_peek(&b1, bits)];
+                    decode_entry e2 = entries[bitreader_peek(&b2, bits)];
+                    decode_entry e3 = entries[bitreader_peek(&b3, bits)];
+                    bitreader_skip(&b0, e0.nbits);
+                    bitreader_skip(&b1, e1.nbits);
+                    bitreader_skip(&b2, e2.nbits);
+                    bitreader_skip(&b3, e3.nbits);
+                    o0[i] = e0.symb;
+                    o1[i] = e1.symb;
+                    o2[i] = e2.symb;
+                    o3[i] = e3.symb;
+                }
+                o0 += k; o1 += k; o2 += k; o3 += k;
+            }
+        }
+        br[0] = b0; br[1] = b1; br[2] = b2; br[3] = b3;
+        o[0] = o0; o[1] = o1; o[2] = o2; o[3] = o3;
+    }
+    // The rest of each stream, or all if there are long codes
+    for (int j = 0; j < CODEC_STREAMS; j++) {
+        int r = codec_decode(dt, &br[j], o[j], end[j] - o[j]);
+        if (r) return r;
+    }
+    return OK;
+}
@@ -0,0 +1,230 @@
+/* codec.h
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef __AH_CODEC_H
+#define __AH_CODEC_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bitio.h"
+#include "freqlist.h"
+
+
+/*
+ * Huffman code of a symbol.
+ */
+typedef struct _huff_code {
+    uint64_t bits;              /* Huffman binary code, aligned to the right */
+    unsigned char nbits;        /* Number of bits used by bits */
+} huff_code;
+
+/*
+ * Dense table with the Huffman code of each symbol,
+ * indexed by the symbol.
+ */
+typedef struct _code_table {
+    huff_code codes[256];
+    unsigned char max_nbits;    /* Length of the longest code */
+    unsigned int length;        /* Number of symbols with a code */
+    unsigned char single_symb;  /* The symbol when length is 1, that
+                                   is encoded with 0 bits */
+} code_table;
+
+#define CODE_TABLE_MAX_SIZE 514     /* Max bytes used to store a table with
+                                       code_table_write */
+
+#define DECODE_TABLE_BITS   12      /* Bits peeked to decode a symbol
+                                       with one lookup */
+#define DECODE_MAX_NBITS    56      /* Max length of a code that can be
+                                       decoded */
+#define CODEC_STREAMS       4       /* Number of streams decoded at once
+                                       with codec_decode_streams */
+#define DECODE_MULTI_SYMBS  4       /* Max symbols decoded with one lookup
+                                       in the multi-symbol table */
+
+/*
+ * Entry in the decoding table, indexed by the
+ * next DECODE_TABLE_BITS bits of the input.
+ */
+typedef struct _decode_entry {
+    unsigned char symb;         /* Symbol decoded, or if nbits is 0, index
+                                   of the first code in long_codes with this
+                                   prefix */
+    unsigned char nbits;        /* Length of the code of symb, or 0 if the
+                                   code is longer than the table bits */
+} decode_entry;
+
+/*
+ * Entry in the multi-symbol decoding table, with all the
+ * symbols whose codes fit complete in the DECODE_TABLE_BITS
+ * bits of the index.
+ */
+typedef struct _decode_multi_entry {
+    unsigned char symbs[DECODE_MULTI_SYMBS];    /* Symbols decoded */
+    unsigned char nsymbs;       /* Number of symbols in symbs, 0 if the
+                                   first code is longer than the table bits */
+    unsigned char nbits;        /* Total length of the codes of symbs */
+} decode_multi_entry;
+
+/*
+ * Table to decode the symbols with one lookup, with a slow
+ * path for the codes longer than DECODE_TABLE_BITS bits.
+ */
+typedef struct _decode_table {
+    decode_entry entries[1 << DECODE_TABLE_BITS];
+    int bits;                   /* Bits used to index entries */
+    unsigned char max_nbits;    /* Length of the longest code */
+    int nlong;                  /* Number of codes longer than bits */
+    huff_code long_codes[256];  /* Codes longer than bits, sorted by
+                                   prefix and then by length */
+    unsigned char long_symbs[256];  /* Symbol of each one of long_codes */
+    unsigned char single_symb;  /* Only symbol if max_nbits is 0 */
+    int min_nbits;              /* Length of the shortest code */
+    int multi;                  /* TRUE if the short codes make worth
+                                   to decode with multi_entries */
+    decode_multi_entry multi_entries[1 << DECODE_TABLE_BITS];
+} decode_table;
+
+/*
+ * Tables to decode with order-1 contexts: each symbol is decoded
+ * with the table of the symbol before it. All the codes fit in
+ * DECODE_TABLE_BITS bits, so each symbol is decoded with one lookup.
+ * The entries without code have nbits = DECODE_CONTEXT_INVALID.
+ */
+typedef struct _decode_context_table {
+    decode_entry entries[256][1 << DECODE_TABLE_BITS];
+    unsigned char used[256];    /* TRUE if the context has a table */
+    unsigned char nbits[256][256];  /* Length of the codes of the table
+                                       of each context, to not build it
+                                       again if it doesn't change */
+    unsigned char single_symb[256];
+} decode_context_table;
+
+#define DECODE_CONTEXT_INVALID  (DECODE_TABLE_BITS + 1)
+
+
+/*
+ * Build the code table from the codes in the freqlist.
+ * Symbols not in the list have a code of 0 bits.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int code_table_build(code_table *t, const freqlist *l);
+
+/*
+ * Store the code table in out, with the canonical Huffman code
+ * lengths: the number of symbols, the max code length, how many
+ * symbols have each length (except the max length, that has the
+ * rest), and then the symbols sorted by code length and symbol.
+ * The codes have to be the canonical codes (see freqlist_canonical).
+ * out needs at least CODE_TABLE_MAX_SIZE bytes.
+ * Return the number of bytes used.
+ */
+size_t code_table_write(const code_table *t, unsigned char *out);
+
+/*
+ * Read the code table stored with code_table_write from the first
+ * len bytes of in, assigning the canonical codes. The codes have
+ * to be complete: every sequence of bits starts with a code, so the
+ * decoders don't need to check for codes that don't exist. The
+ * number of bytes read is set in used.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int code_table_read(code_table *t, const unsigned char *in, size_t len, size_t *used);
+
+/*
+ * Return the number of bits needed to encode the
+ * symbols counted in hist with the code table.
+ */
+uint64_t code_table_encoded_nbits(const code_table *t, const uint64_t hist[256]);
+
+/*
+ * Encode the first len bytes of in, writing their codes into bw.
+ */
+void codec_encode(const code_table *t, const unsigned char *in, size_t len, bitwriter *bw);
+
+/*
+ * Build the decoding table from the code table, that
+ * needs at least one symbol.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int decode_table_build(decode_table *dt, const code_table *t);
+
+/*
+ * Decode n symbols from br into out.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int codec_decode(const decode_table *dt, bitreader *br, unsigned char *out, size_t n);
+
+/*
+ * Decode symbols from br into out, until the position of the
+ * reader (see bitreader_tell) is end or after it, or until max_n
+ * symbols are decoded. The position where each one of the first
+ * nbounds symbols starts is stored in bounds (NULL if nbounds is 0).
+ * The number of symbols decoded is set in n, also if the input
+ * is invalid. The table needs codes of at least one bit.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int codec_decode_until(const decode_table *dt, bitreader *br, unsigned char *out,
+                       size_t max_n, uint64_t end, uint64_t *bounds, size_t nbounds,
+                       size_t *n);
+
+/*
+ * Encode the first len bytes of in with order-1 contexts, writing
+ * the code of each byte with the table of the byte before it (the
+ * table of the context 0 for the first one) into bw. The codes
+ * have to be of DECODE_TABLE_BITS bits at most.
+ */
+void codec_encode_context(const code_table tables[256], const unsigned char *in,
+                          size_t len, bitwriter *bw);
+
+/*
+ * Initialize the context tables, without codes.
+ */
+void decode_context_table_init(decode_context_table *dt);
+
+/*
+ * Build the decoding table of each context from the code table in
+ * tables, if the context is used in the bitmap used, or clear it if not.
+ * The tables that are the same than in the previous call are kept.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int decode_context_table_build(decode_context_table *dt, const code_table tables[256],
+                               const unsigned char used[32]);
+
+/*
+ * Decode n symbols encoded with codec_encode_context from br into out.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int codec_decode_context(const decode_context_table *dt, bitreader *br,
+                         unsigned char *out, size_t n);
+
+/*
+ * Decode CODEC_STREAMS independent streams of codes, each one from
+ * its reader in br, into the consecutive segments of out of n[i]
+ * symbols each. The streams are decoded at once in the same loop,
+ * so the decoding of each stream does not wait for the others.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int codec_decode_streams(const decode_table *dt, bitreader br[CODEC_STREAMS],
+                         unsigned char *out, const size_t n[CODEC_STREAMS]);
+
+
+#endif /* __AH_CODEC_H */
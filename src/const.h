@@ -37,14 +37,43 @@
 #define ERROR_FILE_OUT                  6       /* Cannot open output file */
 #define INVALID_FILE_IN                 7       /* Cannot open input file */
 #define INVALID_BITS_SIZE               8       /* Invalid number of bits to encode a symbol */
+#define INVALID_CPU                     9       /* Instruction set not supported by the CPU */
+#define ERROR_THREAD                    10      /* A thread cannot be created */
+#define ERROR_READ                      11      /* Error reading the input file */
 #define ERROR_UNKNOWN                   50      /* Unknown error */
 
 #define OUTPUT_EXT                      ".ah"   /* Default output file name extension. */
 
 #define MAGIC_NUMBER                    "\x0f\xa1"  /* 2 bytes identifier of the file format */
-#define HEADER_COO_VERSION              1       /* Version of the format used */
+#define HEADER_COO_VERSION              2       /* Version of the format used (version 1,
+                                                   that stores the binary codes instead
+                                                   of the canonical code lengths, can
+                                                   still be decoded) */
 #define HEADER_COO_VERSION_BITS         3       /* Bits used in the header to store the version
                                                    of the format used */
+#define VERSION_BYTE                    (HEADER_COO_VERSION << (8 - HEADER_COO_VERSION_BITS))
+#define VERSION_BYTE_V1                 (1 << (8 - HEADER_COO_VERSION_BITS))
+                                                /* First byte of the header with the version
+                                                   of the format: current one and version 1 */
+#define HEADER_FLAG_BLOCKS              0x01    /* Flag in the second byte of the header: the
+                                                   data is stored in independent blocks, each
+                                                   one with its own table */
+#define HEADER_FLAG_STREAMS             0x02    /* Flag in the second byte of the header: the
+                                                   codes of each block are split in 4 streams
+                                                   (see block.h) */
+#define HEADER_FLAG_INDEX               0x04    /* Flag in the second byte of the header: a
+                                                   seek index is stored after the end of the
+                                                   blocks (see ah_encode) */
+#define HEADER_FLAG_ADAPTIVE            0x08    /* Flag in the second byte of the header: the
+                                                   data is encoded in one stream with adaptive
+                                                   Huffman codes (see adapt.h), without table */
+#define HEADER_FLAG_CONTEXT             0x10    /* Flag in the second byte of the header: the
+                                                   blocks are encoded with order-1 contexts,
+                                                   a table for each previous symbol (see block.h) */
+#define HEADER_FLAG_STORED              0x20    /* Flag in the second byte of the header: the
+                                                   blocks that would not be smaller encoded are
+                                                   stored as is, with the same length encoded
+                                                   than raw (see block.h) */
 #define MAGIC_NUMBER_SIZE               2
 #define NUMBER_SIZE                     8       /* Bytes used to store big numbers in output
                                                    (same than bytes used by the long int type
@@ -57,12 +86,19 @@
                                                    in most platforms) */
 #define SYMBOL_SIZE                     1       /* Bytes used by one symbol (one char) */
 
+#define MAX_CODE_NBITS                  12      /* Default max length of the Huffman codes,
+                                                   to decode any symbol with one lookup */
+#define MAX_THREADS                     256     /* Max threads allowed with -T */
+
 
 #define DEPTH_BUFFER_SIZE               2048    /* 2K buffer used when printing the
                                                    Huffman tree */
-#define BUFFER_WINDOW                   8192    /* 8K initial buffer size and window
-                                                   size to reallocate when using
-                                                   stdin as a source */
+#define READ_BUFFER_SIZE                262144  /* 256K blocks read from the input
+                                                   file to count and encode the symbols */
+#define WRITE_BUFFER_SIZE               262144  /* 256K buffer for the encoded output */
+#define BLOCK_SIZE                      1048576 /* 1M blocks of the input encoded independently */
+#define MAX_BLOCK_SIZE                  1073741824  /* 1G max size of the blocks accepted
+                                                       when decoding */
 
 #define VERBOSE_TABLE                   "> Frequency table and Huffman coding\n"
 #define VERBOSE_TREE                    "> Tree Huffman coding\n"
@@ -21,6 +21,7 @@
 #include "const.h"
 #include "freqlist.h"
 #include <stdlib.h>
+#include <string.h>
 
 
 /* Print the binary number with '0's and 1's for debugging */
@@ -111,13 +112,77 @@ void _freqlist_fprintf_tree(FILE *f, node_freqlist *tree, char *depth, int *di,
     }
 }
 
+/*
+ * Merge the leaves of l, sorted from lower to higher frequency, and the
+ * internal nodes from two queues sorted by frequency, in linear time.
+ * The nodes are given by index: the leaves are 0..n-1 and the internal
+ * nodes are n..2n-2, in the order they are created, that is also from
+ * lower to higher frequency. The children of the internal node n+i
+ * are zero[i] and one[i].
+ * Return the number of leaves.
+ */
+unsigned int _freqlist_merge(freqlist *l, node_freqlist *leaves[256], unsigned long freq[511],
+                             uint16_t zero[255], uint16_t one[255]) {
+    unsigned int n = 0;
+    for (node_freqlist *p = l->list; p && n < 256; p = p->next) {
+        leaves[n] = p;
+        freq[n++] = p->freq;
+    }
+    unsigned int nl = 0, ni = n, last = n;          // Next leaf, next internal node, end
+    for (unsigned int i = 0; i + 1 < n; i++) {      // of the internal nodes queue
+        uint16_t c[2];
+        for (int k = 0; k < 2; k++) {
+            // With the same frequency, the internal node goes first
+            if (ni < last && (nl >= n || freq[ni] <= freq[nl])) {
+                c[k] = ni++;
+            } else {
+                c[k] = nl++;
+            }
+        }
+        one[i] = c[0];                              // Branch one, with the lower frequency
+        zero[i] = c[1];
+        freq[last++] = freq[c[0]] + freq[c[1]];
+    }
+    return n;
+}
+
+/*
+ * Build the linked Huffman tree of l, only used to print it,
+ * with the internal nodes allocated in one block.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int _freqlist_build_tree(freqlist *l) {
+    if (!l->list) return OK;
+    node_freqlist *leaves[256];
+    unsigned long freq[511];
+    uint16_t zero[255], one[255];
+    unsigned int n = _freqlist_merge(l, leaves, freq, zero, one);
+    if (n == 1) {                                   // Only one symbol, the root
+        l->tree = l->list;
+        return OK;
+    }
+    l->inner = (node_freqlist *)calloc(n - 1, sizeof(node_freqlist));
+    if (!l->inner) return ERROR_MEM;
+    for (unsigned int j = 0; j < n - 1; j++) {
+        node_freqlist *p = &l->inner[j];
+        p->freq = freq[n + j];
+        p->zero = zero[j] < n ? leaves[zero[j]] : &l->inner[zero[j] - n];
+        p->one = one[j] < n ? leaves[one[j]] : &l->inner[one[j] - n];
+    }
+    l->tree = &l->inner[n - 2];
+    return OK;
+}
+
 /*
  * Print the tree with the frequencies and binary codes from Huffman coding.
+ * The tree is built the first time it's printed.
  * @f: the output stream, eg. the stdout
  * @title: print this message before the tree (optional)
  * @freql: the frequency list
  */
-void freqlist_fprintf_tree(FILE *f, const char *title, const freqlist *freql) {
+void freqlist_fprintf_tree(FILE *f, const char *title, freqlist *freql) {
+    if (!freql->tree)
+        _freqlist_build_tree(freql);
     if (title)
         fprintf(f, "%s", title);
     int di = 0;
@@ -132,7 +197,7 @@ void freqlist_fprintf_tree(FILE *f, const char *title, const freqlist *freql) {
 freqlist* freqlist_create() {
     freqlist *l = (freqlist *)malloc(sizeof(freqlist));
     if (l) {
-        l->list=l->tree=NULL;
+        l->list=l->tree=l->inner=NULL;
         l->length=0;
         l->size=0L;
     }
@@ -178,13 +243,23 @@ void _freqlist_free_tree(node_freqlist *tree) {
     }
 }
 
+/* free the memory of the "intermediate" nodes of the tree, allocated
+   in one block to print the tree, or one by one otherwise */
+void _freqlist_free_tree_nodes(freqlist *l) {
+    if (l->inner) {
+        free(l->inner);
+        l->inner = NULL;
+    } else if (l->tree) {
+        _freqlist_free_tree(l->tree);
+    }
+    l->tree = NULL;
+}
+
 /*
  * Free the memory of the list.
  */
 void freqlist_free(freqlist* l) {
-    if (l->tree) {
-        _freqlist_free_tree(l->tree);
-    }
+    _freqlist_free_tree_nodes(l);
     _freqlist_free_list(l->list);
     free(l);
 }
@@ -242,6 +317,72 @@ node_freqlist *freqlist_add(freqlist *l, unsigned char c) {
 }
 
 
+/*
+ * Increase the frequency of each symbol with the counts of
+ * the 256 entries histogram hist, adding to the list the symbols
+ * that are not present yet. The list is not sorted after that,
+ * use freqlist_sort.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int freqlist_add_hist(freqlist *l, const uint64_t hist[256]) {
+    node_freqlist *plast = l->list;
+    while (plast && plast->next) plast = plast->next;
+    for (int c = 0; c < 256; c++) {
+        if (!hist[c]) continue;
+        node_freqlist *pnode = freqlist_find(l, (unsigned char) c);
+        if (pnode) {
+            pnode->freq += hist[c];
+        } else {
+            pnode = freqlist_create_node((unsigned char) c, 0, hist[c]);
+            if (!pnode) return ERROR_MEM;
+            if (plast) {                    // Added to the end of the list
+                pnode->pos = plast->pos + 1;
+                pnode->prev = plast;
+                plast->next = pnode;
+            } else {
+                l->list = pnode;
+            }
+            plast = pnode;
+            l->length++;
+        }
+        l->size += hist[c];
+    }
+    return OK;
+}
+
+
+/*
+ * Initialize l with the symbols counted in the 256 entries histogram
+ * hist, using the array nodes for the nodes of the list instead of
+ * allocating them, so l must not be freed with freqlist_free (and
+ * its tree must not be printed). The list is not sorted after that,
+ * use freqlist_sort.
+ */
+void freqlist_init_hist(freqlist *l, node_freqlist nodes[256], const uint64_t hist[256]) {
+    l->list = l->tree = l->inner = NULL;
+    l->length = 0;
+    l->size = 0L;
+    node_freqlist *plast = NULL;
+    for (int c = 0; c < 256; c++) {
+        if (!hist[c]) continue;
+        node_freqlist *pnode = &nodes[l->length];
+        pnode->symb = (unsigned char) c;
+        pnode->pos = l->length;
+        pnode->freq = hist[c];
+        pnode->next = pnode->tnext = pnode->zero = pnode->one = NULL;
+        pnode->prev = plast;
+        if (plast) {
+            plast->next = pnode;
+        } else {
+            l->list = pnode;
+        }
+        plast = pnode;
+        l->length++;
+        l->size += hist[c];
+    }
+}
+
+
 /* Promote the position of the symbol in the list */
 void _freqlist_promote(freqlist *l, node_freqlist *pnode) {
     unsigned char i;
@@ -387,117 +528,182 @@ void _freqlist_dispromote(freqlist *l, node_freqlist *pnode) {
 }
 
 /*
- * Swap position with the next element in the list.
- *
- *     pnode0          pnode0    (could be NULL)
- *     pnode1    |-->  *pnode
- *     *pnode  ---     pnode1
- *     pnode2          pnode2    (could be NULL)
- *
- * If pnode0 is NULL, then l->list = pnode (first element
- * in the list).
- *
- * Return 1 if the element were swapped, else 0.
+ * Sort the frequencies in case aren't sort: from lower to higher
+ * frequency, and with the same frequency from higher to lower symbol
+ * (see node_cmp). The nodes are sorted in an array with a radix sort,
+ * one pass by symbol and one pass by each byte used by the frequencies,
+ * and then the list is linked again in that order.
+ * Return the number of nodes that changed of position.
  */
-int _freqlist_swap_with_prev(freqlist *l, node_freqlist * pnode) {
-    if (pnode->prev) {
-        node_freqlist * pnode1 = pnode->prev;
-        node_freqlist * pnode0 = pnode1->prev;
-        node_freqlist * pnode2 = pnode->next;
-        if (pnode0) {
-            pnode0->next = pnode;
-        } else {
-            l->list = pnode;
+int freqlist_sort(freqlist *l) {
+    node_freqlist *nodes[256], *sorted[256];
+    unsigned int n = 0;
+    unsigned long any_freq = 0;
+    for (node_freqlist *p = l->list; p && n < 256; p = p->next) {
+        nodes[n++] = p;
+        any_freq |= p->freq;
+    }
+    if (n < 2) return 0;
+
+    // First by symbol, from higher to lower: there is only one node by symbol
+    node_freqlist *by_symb[256] = { NULL };
+    for (unsigned int i = 0; i < n; i++) {
+        by_symb[255 - nodes[i]->symb] = nodes[i];
+    }
+    unsigned int k = 0;
+    for (int c = 0; c < 256; c++) {
+        if (by_symb[c]) sorted[k++] = by_symb[c];
+    }
+
+    // Then by frequency, from the lowest byte to the highest byte used,
+    // keeping the order of the previous passes with the same byte
+    node_freqlist *tmp[256];
+    for (int shift = 0; shift < (int) (8 * sizeof(unsigned long)) && (any_freq >> shift); shift += 8) {
+        unsigned int count[257] = { 0 };
+        for (unsigned int i = 0; i < n; i++) {
+            count[((sorted[i]->freq >> shift) & 0xFF) + 1]++;
         }
-        pnode->prev = pnode0;
-        pnode->next = pnode1;
-        pnode1->prev = pnode;
-        pnode1->next = pnode2;
-        if (pnode2) {
-            pnode2->prev = pnode1;
+        for (int d = 0; d < 256; d++) {
+            count[d + 1] += count[d];
         }
-        unsigned char pnode_pos = pnode->pos;
-        pnode->pos = pnode1->pos;
-        pnode1->pos = pnode_pos;
-        return 1;
+        for (unsigned int i = 0; i < n; i++) {
+            tmp[count[(sorted[i]->freq >> shift) & 0xFF]++] = sorted[i];
+        }
+        memcpy(sorted, tmp, n * sizeof(node_freqlist *));
     }
-    return 0;
-}
 
+    int moved = 0;
+    l->list = sorted[0];
+    for (unsigned int i = 0; i < n; i++) {
+        if (sorted[i] != nodes[i]) moved++;
+        sorted[i]->pos = (unsigned char) i;
+        sorted[i]->prev = i > 0 ? sorted[i - 1] : NULL;
+        sorted[i]->next = i + 1 < n ? sorted[i + 1] : NULL;
+    }
+    return moved;
+}
 
 /*
- * Sort the frequencies in case aren't sort.
- * Return the number of swaps made.
+ * Build the Huffman binary codes for encoding.
+ * The freqlist has to be sorted first.
+ * The leaves and the internal nodes are merged from two
+ * queues sorted by frequency, in linear time, without
+ * allocating the tree: it's only built to print it.
+ * Return 0 if no errors, otherwise an error code.
  */
-int freqlist_sort(freqlist *l) {
-    int swaps = 0;
-    // Gnome sort implementation
-    node_freqlist * pnode = l->list;
-    while (pnode) {
-        if (pnode == l->list || node_cmp(pnode, pnode->prev) < 0) {
-            pnode = pnode->next;
-        } else {
-            //node_freqlist * pnode_prev = pnode->prev;
-            /* swap pnode and pnode->prev */
-            _freqlist_swap_with_prev(l, pnode);
-            swaps++;
-        }
+int freqlist_build_huff(freqlist *l) {
+    if (!l->list) return 0;
+    _freqlist_free_tree_nodes(l);
+    node_freqlist *leaves[256];
+    unsigned long freq[511];
+    uint16_t zero[255], one[255];
+    unsigned int n = _freqlist_merge(l, leaves, freq, zero, one);
+    if (n == 1) {                                   // Only one symbol, without code
+        l->list->bits = 0;
+        l->list->nbits = 0;
+        return OK;
     }
-    return swaps;
-}
 
-/* Insert the element in the list, sorted by frequency from lower to higher */
-void _insert_order(node_freqlist** head, node_freqlist *e) {
-    node_freqlist *p = *head, *a = NULL;
-    // Find the symbol in the list (sorted by freq)
-    while(p && p->freq < e->freq) {
-        a = p;                  // Keep the current element to insert after
-        p = p->tnext;
-    }
-    // Insert the element
-    e->tnext = p;
-    if(a) a->tnext = e;         // Insert between a and p
-    else *head = e;             // the new is the first
+    // Codes from the root (the last node) to the leaves
+    unsigned int last = 2 * n - 1;
+    unsigned long bits[511];
+    unsigned char nbits[511];
+    bits[last - 1] = 0;
+    nbits[last - 1] = 0;
+    for (unsigned int i = last - 1; i >= n; i--) {
+        unsigned int j = i - n;
+        bits[zero[j]] = bits[i] << 1;
+        bits[one[j]] = (bits[i] << 1) | 1;
+        nbits[zero[j]] = nbits[one[j]] = nbits[i] + 1;
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        leaves[i]->bits = bits[i];
+        leaves[i]->nbits = nbits[i];
+    }
+    return OK;
 }
 
-void _build_binary_code(node_freqlist *n, int len, int v)
-{
-//   if(n->one)  _build_binary_code(n->one, len+1, (v<<1)|1);
-//   if(n->zero) _build_binary_code(n->zero, len+1, v<<1);
-    if(n->zero) _build_binary_code(n->zero, len + 1, v << 1);
-    if(n->one)  _build_binary_code(n->one, len + 1, (v << 1)|1);
-    if(!n->zero && !n->one) {
-        n->bits = v;
-        n->nbits = len;
+
+/*
+ * Limit the length of the codes built by freqlist_build_huff
+ * to max_nbits bits (or the min length needed for the number of
+ * symbols, if greater). The lengths over the limit are cut, and then
+ * the codes of the symbols with less frequency are made longer until
+ * the lengths are valid for a prefix code, and the codes of the
+ * symbols with more frequency are made shorter if there is room.
+ * The binary codes have to be built again with freqlist_canonical.
+ * Return the max length of the codes.
+ */
+unsigned char freqlist_limit_nbits(freqlist *l, unsigned char max_nbits) {
+    node_freqlist *p, *plast = NULL;
+    unsigned char max = 0;
+    for (p = l->list; p; p = p->next) {
+        if (p->nbits > max) max = p->nbits;
+        plast = p;
+    }
+    if (max <= max_nbits) return max;
+    while ((1UL << max_nbits) < l->length) max_nbits++;
+    // Kraft sum of the lengths, in units of 2^-max_nbits: it's a
+    // prefix code if the sum is less or equal than 1 (1 << max_nbits)
+    const unsigned long one = 1UL << max_nbits;
+    unsigned long kraft = 0;
+    for (p = l->list; p; p = p->next) {
+        if (p->nbits > max_nbits) p->nbits = max_nbits;
+        kraft += one >> p->nbits;
+    }
+    while (kraft > one) {
+        // Make longer the code of the symbol with less frequency
+        // (the list is sorted from lower to higher frequency)
+        for (p = l->list; p->nbits >= max_nbits; p = p->next);
+        p->nbits++;
+        kraft -= one >> p->nbits;
+    }
+    int shortened = TRUE;
+    while (shortened) {
+        // Make shorter the codes of the symbols with more frequency if possible
+        shortened = FALSE;
+        for (p = plast; p; p = p->prev) {
+            if (p->nbits > 1 && kraft + (one >> p->nbits) <= one) {
+                kraft += one >> p->nbits;
+                p->nbits--;
+                shortened = TRUE;
+            }
+        }
     }
+    max = 0;
+    for (p = l->list; p; p = p->next) {
+        if (p->nbits > max) max = p->nbits;
+    }
+    return max;
 }
 
 /*
- * Build the Huffman tree and binary
- * codes for encoding.
- * The freqlist has to be sorted first.
+ * Replace the binary codes built by freqlist_build_huff
+ * with the canonical Huffman codes of the same lengths: sorted
+ * by code length and then by symbol, each code is the
+ * next binary number of the previous code, extended
+ * with 0s to its length.
  */
-int freqlist_build_huff(freqlist *l) {
-    if (!l->list) return 0;
-    l->tree = l->list;
-    node_freqlist *p = l->list;
-    while (p) {
-        p->tnext = p->next;
-        p = p->next;
-    }
-    while (l->tree && l->tree->tnext) {              // While exist at least 2 elements in the list
-        p = (node_freqlist *)malloc(sizeof(node_freqlist));     // A new tree node (that is a sub-tree)
-        if (!p) return ERROR_MEM;
-        p->symb = 0;                                            // Does not correspond to any symbol
-        p->one = l->tree;                                       // Branch one
-        l->tree = l->tree->tnext;                               // Next node
-        p->zero = l->tree;                                      // branch zero
-        l->tree = l->tree->tnext;                               // Next node
-        p->freq = p->zero->freq + p->one->freq;                 // Sum of frequencies
-        _insert_order(&(l->tree), p);                           // Insert in new node
-    }
-    _build_binary_code(l->tree, 0, 0);
-    return OK;
+void freqlist_canonical(freqlist *l) {
+    node_freqlist *nodes[256];
+    int n = 0;
+    for (node_freqlist *p = l->list; p && n < 256; p = p->next) {
+        // Insertion sort by (nbits, symb), only 256 symbols at most
+        int i = n++;
+        while (i > 0 && (nodes[i-1]->nbits > p->nbits
+                         || (nodes[i-1]->nbits == p->nbits && nodes[i-1]->symb > p->symb))) {
+            nodes[i] = nodes[i-1];
+            i--;
+        }
+        nodes[i] = p;
+    }
+    unsigned long code = 0;
+    for (int i = 0; i < n; i++) {
+        if (i > 0) {
+            code = (code + 1) << (nodes[i]->nbits - nodes[i-1]->nbits);
+        }
+        nodes[i]->bits = code;
+    }
 }
 
 
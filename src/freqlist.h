@@ -23,6 +23,7 @@
 
 
 #include <stdio.h>
+#include <stdint.h>
 
 
 /*
@@ -82,6 +83,9 @@ typedef struct _freqlist
     node_freqlist *tree;            /* Pointer to the first node in the Huffman
                                        tree (not a char unless the tree only has
                                        one symbol). */
+    node_freqlist *inner;           /* Internal nodes of the tree built to
+                                       print it, allocated in one block,
+                                       or NULL. */
     unsigned int length;            /* Numbers of different symbols
                                        in the list. */
     unsigned long size;             /* Numbers of symbols in the list. */
@@ -120,6 +124,24 @@ node_freqlist *freqlist_find(const freqlist* l, unsigned char c);
  */
 node_freqlist *freqlist_add(freqlist *l, unsigned char c);
 
+/*
+ * Increase the frequency of each symbol with the counts of
+ * the 256 entries histogram hist, adding to the list the symbols
+ * that are not present yet. The list is not sorted after that,
+ * use freqlist_sort.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int freqlist_add_hist(freqlist *l, const uint64_t hist[256]);
+
+/*
+ * Initialize l with the symbols counted in the 256 entries histogram
+ * hist, using the array nodes for the nodes of the list instead of
+ * allocating them, so l must not be freed with freqlist_free (and
+ * its tree must not be printed). The list is not sorted after that,
+ * use freqlist_sort.
+ */
+void freqlist_init_hist(freqlist *l, node_freqlist nodes[256], const uint64_t hist[256]);
+
 /*
  * Print the list of frequencies and binary codes from Huffman coding.
  * @f: the output stream, eg. the stdout
@@ -130,27 +152,55 @@ void freqlist_fprintf(FILE *f, const char *title, const freqlist *freql);
 
 /*
  * Print the tree with the frequencies and binary codes from Huffman coding.
+ * The tree is built the first time it's printed.
  * @f: the output stream, eg. the stdout
  * @title: print this message before the tree (optional)
  * @freql: the frequency list
  */
-void freqlist_fprintf_tree(FILE *f, const char *title, const freqlist *freql);
+void freqlist_fprintf_tree(FILE *f, const char *title, freqlist *freql);
 
 
 /*
- * Sort the frequencies in case aren't sort.
- * Return the number of swaps made.
+ * Sort the frequencies in case aren't sort: from lower to higher
+ * frequency, and with the same frequency from higher to lower symbol
+ * (see node_cmp).
+ * Return the number of nodes that changed of position.
  */
 int freqlist_sort(freqlist *l);
 
 /*
- * Build the Huffman tree and binary
- * codes for encoding.
+ * Build the Huffman binary codes for encoding.
  * The freqlist has to be sorted first.
+ * The leaves and the internal nodes are merged from two
+ * queues sorted by frequency, in linear time, without
+ * allocating the tree: it's only built to print it.
+ * Return 0 if no errors, otherwise an error code.
  */
 int freqlist_build_huff(freqlist *l);
 
 
+/*
+ * Limit the length of the codes built by freqlist_build_huff
+ * to max_nbits bits (or the min length needed for the number of
+ * symbols, if greater). The lengths over the limit are cut, and then
+ * the codes of the symbols with less frequency are made longer until
+ * the lengths are valid for a prefix code, and the codes of the
+ * symbols with more frequency are made shorter if there is room.
+ * The binary codes have to be built again with freqlist_canonical.
+ * Return the max length of the codes.
+ */
+unsigned char freqlist_limit_nbits(freqlist *l, unsigned char max_nbits);
+
+/*
+ * Replace the binary codes built by freqlist_build_huff
+ * with the canonical Huffman codes of the same lengths: sorted
+ * by code length and then by symbol, each code is the
+ * next binary number of the previous code, extended
+ * with 0s to its length.
+ */
+void freqlist_canonical(freqlist *l);
+
+
 /*
  * Compare by frequency of the node,
  * or symbol if the frequencies are equal.
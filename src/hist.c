@@ -0,0 +1,290 @@
+/* hist.c
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "const.h"
+#include "hist.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HIST_X86
+#include <immintrin.h>
+#endif
+
+
+#define HIST_TABLES     4                   /* Interleaved sub-histograms */
+#define HIST_CHUNK      (1UL << 30)         /* Max bytes counted with the 32-bit
+                                               counters before adding them into
+                                               the 64-bit histogram */
+
+
+/*
+ * Clear the histogram, setting the frequency
+ * of all the symbols to 0.
+ */
+void hist_clear(uint64_t hist[HIST_SYMBOLS]) {
+    memset(hist, 0, HIST_SYMBOLS * sizeof(uint64_t));
+}
+
+/* Count the 8 symbols packed in the 64-bit word w into the sub-histograms t */
+#define COUNT_WORD(t, w)                                        \
+    do {                                                        \
+        t[0][(unsigned char) (w)]++;                            \
+        t[1][(unsigned char) ((w) >> 8)]++;                     \
+        t[2][(unsigned char) ((w) >> 16)]++;                    \
+        t[3][(unsigned char) ((w) >> 24)]++;                    \
+        t[0][(unsigned char) ((w) >> 32)]++;                    \
+        t[1][(unsigned char) ((w) >> 40)]++;                    \
+        t[2][(unsigned char) ((w) >> 48)]++;                    \
+        t[3][(unsigned char) ((w) >> 56)]++;                    \
+    } while (0)
+
+/* Add the sub-histograms t into hist */
+void _hist_flush(uint64_t hist[HIST_SYMBOLS], uint32_t t[HIST_TABLES][HIST_SYMBOLS]) {
+    for (int i = 0; i < HIST_SYMBOLS; i++) {
+        hist[i] += (uint64_t) t[0][i] + t[1][i] + t[2][i] + t[3][i];
+    }
+}
+
+/*
+ * Portable kernel, count a chunk of at most HIST_CHUNK bytes.
+ * Consecutive bytes go to different sub-histograms, so a run of
+ * the same symbol does not make each increment wait for the store
+ * of the previous one.
+ */
+void _hist_count_scalar(uint64_t hist[HIST_SYMBOLS], const unsigned char *buf, size_t len) {
+    uint32_t t[HIST_TABLES][HIST_SYMBOLS];
+    memset(t, 0, sizeof(t));
+    const unsigned char *end = buf + len;
+    while (buf + 8 <= end) {
+        uint64_t w;
+        memcpy(&w, buf, 8);                         // One load for 8 symbols
+        COUNT_WORD(t, w);
+        buf += 8;
+    }
+    while (buf < end) {
+        t[0][*buf++]++;
+    }
+    _hist_flush(hist, t);
+}
+
+
+#ifdef HIST_X86
+
+/*
+ * SSE2 kernel: 16 bytes are loaded at once, if all of them
+ * are the same symbol (common in sparse binary data) the
+ * count is increased in 16 with just one add, otherwise
+ * the two 64-bit halves are counted like the scalar kernel.
+ */
+__attribute__((target("sse2")))
+void _hist_count_sse2(uint64_t hist[HIST_SYMBOLS], const unsigned char *buf, size_t len) {
+    uint32_t t[HIST_TABLES][HIST_SYMBOLS];
+    memset(t, 0, sizeof(t));
+    const unsigned char *end = buf + len;
+    while (buf + 16 <= end) {
+        __m128i v = _mm_loadu_si128((const __m128i *) buf);
+        __m128i first = _mm_set1_epi8((char) buf[0]);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, first)) == 0xFFFF) {
+            t[0][buf[0]] += 16;                     // Run of the same symbol
+        } else {
+            uint64_t lo = (uint64_t) _mm_cvtsi128_si64(v);
+            uint64_t hi = (uint64_t) _mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v));
+            COUNT_WORD(t, lo);
+            COUNT_WORD(t, hi);
+        }
+        buf += 16;
+    }
+    while (buf < end) {
+        t[0][*buf++]++;
+    }
+    _hist_flush(hist, t);
+}
+
+/*
+ * AVX2 kernel, same than the SSE2 kernel but
+ * with 32 bytes loaded at once.
+ */
+__attribute__((target("avx2")))
+void _hist_count_avx2(uint64_t hist[HIST_SYMBOLS], const unsigned char *buf, size_t len) {
+    uint32_t t[HIST_TABLES][HIST_SYMBOLS];
+    memset(t, 0, sizeof(t));
+    const unsigned char *end = buf + len;
+    while (buf + 32 <= end) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) buf);
+        __m256i first = _mm256_set1_epi8((char) buf[0]);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, first)) == -1) {
+            t[0][buf[0]] += 32;                     // Run of the same symbol
+        } else {
+            __m128i l = _mm256_castsi256_si128(v);
+            __m128i h = _mm256_extracti128_si256(v, 1);
+            uint64_t w0 = (uint64_t) _mm_cvtsi128_si64(l);
+            uint64_t w1 = (uint64_t) _mm_extract_epi64(l, 1);
+            uint64_t w2 = (uint64_t) _mm_cvtsi128_si64(h);
+            uint64_t w3 = (uint64_t) _mm_extract_epi64(h, 1);
+            COUNT_WORD(t, w0);
+            COUNT_WORD(t, w1);
+            COUNT_WORD(t, w2);
+            COUNT_WORD(t, w3);
+        }
+        buf += 32;
+    }
+    while (buf < end) {
+        t[0][*buf++]++;
+    }
+    _hist_flush(hist, t);
+}
+
+/*
+ * AVX-512 kernel, same than the SSE2 kernel but with 64 bytes
+ * loaded at once. A gather/scatter kernel with vpconflictd to detect
+ * the repeated symbols was slower than the scalar one.
+ */
+__attribute__((target("avx512f,avx512bw")))
+void _hist_count_avx512(uint64_t hist[HIST_SYMBOLS], const unsigned char *buf, size_t len) {
+    uint32_t t[HIST_TABLES][HIST_SYMBOLS];
+    memset(t, 0, sizeof(t));
+    const unsigned char *end = buf + len;
+    while (buf + 64 <= end) {
+        __m512i v = _mm512_loadu_si512((const void *) buf);
+        __m512i first = _mm512_set1_epi8((char) buf[0]);
+        if (_mm512_cmpeq_epi8_mask(v, first) == ~(__mmask64) 0) {
+            t[0][buf[0]] += 64;                     // Run of the same symbol
+        } else {
+            for (int i = 0; i < 64; i += 16) {
+                __m128i l = _mm_loadu_si128((const __m128i *) (buf + i));
+                uint64_t lo = (uint64_t) _mm_cvtsi128_si64(l);
+                uint64_t hi = (uint64_t) _mm_extract_epi64(l, 1);
+                COUNT_WORD(t, lo);
+                COUNT_WORD(t, hi);
+            }
+        }
+        buf += 64;
+    }
+    while (buf < end) {
+        t[0][*buf++]++;
+    }
+    _hist_flush(hist, t);
+}
+
+#endif /* HIST_X86 */
+
+
+typedef void (*hist_kernel)(uint64_t hist[HIST_SYMBOLS], const unsigned char *buf, size_t len);
+
+/* Kernels available, by order of preference */
+static const struct {
+    const char *name;
+    hist_kernel count;
+} _hist_kernels[] = {
+#ifdef HIST_X86
+    { "avx512", _hist_count_avx512 },
+    { "avx2", _hist_count_avx2 },
+    { "sse2", _hist_count_sse2 },
+#endif
+    { "scalar", _hist_count_scalar },
+};
+
+#define HIST_KERNELS    (sizeof(_hist_kernels) / sizeof(_hist_kernels[0]))
+
+/* Index in _hist_kernels of the kernel used, -1 until selected */
+static int _hist_kernel = -1;
+static pthread_once_t _hist_kernel_once = PTHREAD_ONCE_INIT;
+
+/* Return TRUE if the CPU where the process runs supports the kernel i */
+int _hist_kernel_supported(int i) {
+#ifdef HIST_X86
+    const char *name = _hist_kernels[i].name;
+    __builtin_cpu_init();
+    if (!strcmp(name, "avx512"))
+        return __builtin_cpu_supports("avx512f")
+               && __builtin_cpu_supports("avx512bw");
+    if (!strcmp(name, "avx2"))
+        return __builtin_cpu_supports("avx2");
+    if (!strcmp(name, "sse2"))
+        return __builtin_cpu_supports("sse2");
+#endif
+    return TRUE;        // scalar
+}
+
+/* Select the widest kernel supported by the CPU, if not selected yet */
+void _hist_default_kernel(void) {
+    if (_hist_kernel < 0) {
+        unsigned int i = 0;
+        while (i < HIST_KERNELS - 1 && !_hist_kernel_supported(i)) i++;
+        _hist_kernel = i;
+    }
+}
+
+/* Return the kernel selected, selecting it only once in the process */
+int _hist_select_kernel(void) {
+    pthread_once(&_hist_kernel_once, _hist_default_kernel);
+    return _hist_kernel;
+}
+
+/*
+ * Select the kernel used to count by name: "scalar",
+ * "sse2", "avx2" or "avx512". By default the widest
+ * kernel supported by the CPU is used. It's a setting of
+ * the whole process, to call before counting in any thread.
+ * Return 0 if no errors, ERROR_PARAM if the name is unknown
+ * or INVALID_CPU if the CPU does not support the kernel.
+ */
+int hist_set_cpu(const char *name) {
+    for (unsigned int i = 0; i < HIST_KERNELS; i++) {
+        if (!strcmp(name, _hist_kernels[i].name)) {
+            if (!_hist_kernel_supported(i)) return INVALID_CPU;
+            _hist_kernel = i;
+            return OK;
+        }
+    }
+    return ERROR_PARAM;
+}
+
+/*
+ * Return the name of the kernel used to count.
+ */
+const char *hist_cpu_name(void) {
+    return _hist_kernels[_hist_select_kernel()].name;
+}
+
+/*
+ * Add to hist the occurrences of each symbol in the
+ * first len bytes of buf.
+ */
+void hist_count(uint64_t hist[HIST_SYMBOLS], const unsigned char *buf, size_t len) {
+    hist_kernel count = _hist_kernels[_hist_select_kernel()].count;
+    while (len > 0) {
+        size_t n = len < HIST_CHUNK ? len : HIST_CHUNK;
+        count(hist, buf, n);
+        buf += n;
+        len -= n;
+    }
+}
+
+/*
+ * Add the frequencies of src into dst.
+ */
+void hist_merge(uint64_t dst[HIST_SYMBOLS], const uint64_t src[HIST_SYMBOLS]) {
+    for (int i = 0; i < HIST_SYMBOLS; i++) {
+        dst[i] += src[i];
+    }
+}
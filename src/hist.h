@@ -0,0 +1,65 @@
+/* hist.h
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef __AH_HIST_H
+#define __AH_HIST_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define HIST_SYMBOLS                    256     /* Number of different symbols (one byte) */
+
+
+/*
+ * Clear the histogram, setting the frequency
+ * of all the symbols to 0.
+ */
+void hist_clear(uint64_t hist[HIST_SYMBOLS]);
+
+/*
+ * Add to hist the occurrences of each symbol in the
+ * first len bytes of buf.
+ */
+void hist_count(uint64_t hist[HIST_SYMBOLS], const unsigned char *buf, size_t len);
+
+/*
+ * Select the kernel used to count by name: "scalar",
+ * "sse2", "avx2" or "avx512". By default the widest
+ * kernel supported by the CPU is used. It's a setting of
+ * the whole process, to call before counting in any thread.
+ * Return 0 if no errors, ERROR_PARAM if the name is unknown
+ * or INVALID_CPU if the CPU does not support the kernel.
+ */
+int hist_set_cpu(const char *name);
+
+/*
+ * Return the name of the kernel used to count.
+ */
+const char *hist_cpu_name(void);
+
+/*
+ * Add the frequencies of src into dst.
+ */
+void hist_merge(uint64_t dst[HIST_SYMBOLS], const uint64_t src[HIST_SYMBOLS]);
+
+
+#endif /* __AH_HIST_H */
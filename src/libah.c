@@ -0,0 +1,722 @@
+/* libah.c
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "libah.h"
+#include "adapt.h"
+#include "ah.h"
+#include "block.h"
+
+
+#define HEADER_SIZE         (MAGIC_NUMBER_SIZE + 2)
+#define STREAM_HEAD_SIZE    12  /* Max bytes of the headers in the stream:
+                                   the header of the file, with the
+                                   block size, or the header of a block */
+
+#if AH_OK != OK || AH_ERROR_MEM != ERROR_MEM || AH_ERROR_PARAM != ERROR_PARAM \
+        || AH_INVALID_FILE_IN != INVALID_FILE_IN || AH_INVALID_BITS_SIZE != INVALID_BITS_SIZE \
+        || AH_ERROR_THREAD != ERROR_THREAD
+#error "The error codes of libah.h have to be the same than in const.h"
+#endif
+
+
+/*
+ * Context to compress and decompress buffers in memory
+ * (see libah.h).
+ */
+struct _ah_ctx {
+    /* Options, that can be changed between calls */
+    int threads;                /* Number of threads to use (default 1) */
+    unsigned char max_nbits;    /* Max length of the Huffman codes
+                                   (default MAX_CODE_NBITS) */
+    int streams;                /* Number of streams the codes of each
+                                   block are split in: 1 or CODEC_STREAMS */
+    int context;                /* If TRUE the blocks are encoded with
+                                   order-1 contexts */
+    int fast;                   /* If TRUE the tables are built from
+                                   samples of the blocks */
+
+    /* Buffers kept between calls */
+    block *blocks;              /* Blocks processed at once */
+    int nblocks;
+    block_tables tables;        /* Decoding tables of the threads */
+    adapt_model *model;         /* Adaptive model, to decode in that mode */
+    unsigned char *out;         /* Output of the last call */
+    size_t size_out;            /* Size of out */
+    int error;                  /* Error code of the last call, 0 if no
+                                   errors (see ah_strerror) */
+};
+
+/*
+ * State of an incremental compression or decompression
+ * (see libah.h).
+ */
+struct _ah_stream {
+    /* Options, that can be changed before the first call */
+    unsigned char max_nbits;    /* Max length of the Huffman codes
+                                   (default MAX_CODE_NBITS) */
+    int streams;                /* Number of streams the codes of each
+                                   block are split in: 1 or CODEC_STREAMS */
+    int context;                /* If TRUE the blocks are encoded with
+                                   order-1 contexts */
+    int fast;                   /* If TRUE the tables are built from
+                                   samples of the blocks */
+    unsigned int max_block_size;    /* Max size of the blocks to decode
+                                       (default BLOCK_SIZE) */
+
+    /* State between calls */
+    int decode;                 /* TRUE to decompress */
+    int state;                  /* Next thing to write or read */
+    block b;                    /* Block processed */
+    block_tables tables;        /* Decoding tables */
+    unsigned char *acc;         /* Input of the block received until now,
+                                   when it's split in many calls */
+    size_t len_acc;             /* Bytes in acc */
+    size_t size_acc;            /* Size of acc */
+    unsigned char head[STREAM_HEAD_SIZE];   /* Header to write,
+                                               or read until now */
+    size_t len_head;            /* Bytes in head */
+    size_t pos_head;            /* Bytes of head already written */
+    const unsigned char *body;  /* Output of the block to write */
+    size_t len_body;            /* Bytes in body */
+    size_t pos_body;            /* Bytes of body already written */
+    unsigned int block_size;    /* Size of the blocks */
+    unsigned int len_raw;       /* Raw length of the block read */
+    unsigned int len_enc;       /* Encoded length of the block read */
+    unsigned char flags;        /* Flags of the header read */
+    int error;                  /* Error code, 0 if no errors */
+};
+
+
+/* Set an option of a context or a stream, see ah_ctx_set_option */
+int _libah_set_option(int option, int value, int *threads, unsigned char *max_nbits,
+                      int *streams, int *context, int *fast, unsigned int *max_block_size) {
+    switch (option) {
+        case AH_OPT_THREADS:
+            if (!threads || value < 1 || value > MAX_THREADS) return ERROR_PARAM;
+            *threads = value;
+            break;
+        case AH_OPT_MAX_CODE_LEN:
+            if (value < 1 || value > DECODE_MAX_NBITS) return ERROR_PARAM;
+            *max_nbits = (unsigned char) value;
+            break;
+        case AH_OPT_INTERLEAVE:
+            *streams = value ? CODEC_STREAMS : 1;
+            break;
+        case AH_OPT_CONTEXT:
+            *context = value ? TRUE : FALSE;
+            break;
+        case AH_OPT_FAST:
+            *fast = value ? TRUE : FALSE;
+            break;
+        case AH_OPT_MAX_BLOCK_SIZE:
+            if (!max_block_size || value < 1 || value > MAX_BLOCK_SIZE) return ERROR_PARAM;
+            *max_block_size = (unsigned int) value;
+            break;
+        default:
+            return ERROR_PARAM;
+    }
+    return OK;
+}
+
+
+/*
+ * Create a context with the default options.
+ * Return NULL if there is no memory.
+ */
+ah_ctx *ah_ctx_create(void) {
+    ah_ctx *ctx = (ah_ctx *) malloc(sizeof(ah_ctx));
+    if (ctx) {
+        ctx->threads = 1;
+        ctx->max_nbits = MAX_CODE_NBITS;
+        ctx->streams = 1;
+        ctx->context = FALSE;
+        ctx->fast = FALSE;
+        ctx->blocks = NULL;
+        ctx->nblocks = 0;
+        block_tables_init(&ctx->tables);
+        ctx->model = NULL;
+        ctx->out = NULL;
+        ctx->size_out = 0;
+        ctx->error = OK;
+    }
+    return ctx;
+}
+
+/*
+ * Free the context and its buffers.
+ */
+void ah_ctx_free(ah_ctx *ctx) {
+    if (!ctx) return;
+    for (int i = 0; i < ctx->nblocks; i++) {
+        block_free(&ctx->blocks[i]);
+    }
+    free(ctx->blocks);
+    block_tables_free(&ctx->tables);
+    free(ctx->model);
+    free(ctx->out);
+    free(ctx);
+}
+
+/*
+ * Set an option of the context (AH_OPT_*, except
+ * AH_OPT_MAX_BLOCK_SIZE), that can be changed between calls.
+ * Return 0 if no errors, or AH_ERROR_PARAM if the option or
+ * the value are not valid.
+ */
+int ah_ctx_set_option(ah_ctx *ctx, int option, int value) {
+    return _libah_set_option(option, value, &ctx->threads, &ctx->max_nbits,
+                             &ctx->streams, &ctx->context, &ctx->fast, NULL);
+}
+
+/*
+ * Return the error code of the last call with the context,
+ * 0 if no errors (see ah_strerror).
+ */
+int ah_ctx_error(const ah_ctx *ctx) {
+    return ctx->error;
+}
+
+/* Make room for len bytes in the output, growing it at least twice */
+int _libah_reserve(ah_ctx *ctx, size_t len) {
+    if (ctx->size_out >= len) {
+        return OK;
+    }
+    size_t size = ctx->size_out * 2 > len ? ctx->size_out * 2 : len;
+    return block_reserve(&ctx->out, &ctx->size_out, size);
+}
+
+/* Make room for the blocks processed at once by the threads */
+int _libah_blocks(ah_ctx *ctx) {
+    int n = ctx->threads < 1 ? 1 : ctx->threads > MAX_THREADS ? MAX_THREADS : ctx->threads;
+    if (ctx->nblocks < n) {
+        block *blocks = (block *) realloc(ctx->blocks, n * sizeof(block));
+        if (!blocks) return ERROR_MEM;
+        for (int i = ctx->nblocks; i < n; i++) {
+            block_init(&blocks[i]);
+        }
+        ctx->blocks = blocks;
+        ctx->nblocks = n;
+    }
+    return OK;
+}
+
+/* Compress the input, see ah_compress_buffer */
+int _libah_compress(ah_ctx *ctx, const unsigned char *in, size_t len,
+                    const unsigned char **out, size_t *len_out) {
+    int r = _libah_blocks(ctx);
+    if (!r) r = _libah_reserve(ctx, HEADER_SIZE + COUNT_SIZE);
+    if (r) return r;
+    int nthreads = ctx->nblocks;
+    unsigned char *p = ctx->out;
+    memcpy(p, MAGIC_NUMBER, MAGIC_NUMBER_SIZE);
+    p[MAGIC_NUMBER_SIZE] = VERSION_BYTE;
+    p[MAGIC_NUMBER_SIZE + 1] = HEADER_FLAG_BLOCKS | HEADER_FLAG_STORED
+                               | (ctx->context ? HEADER_FLAG_CONTEXT
+                                  : ctx->streams > 1 ? HEADER_FLAG_STREAMS : 0);
+    unsigned int block_size = BLOCK_SIZE;
+    memcpy(p + HEADER_SIZE, &block_size, COUNT_SIZE);
+    size_t pos = HEADER_SIZE + COUNT_SIZE;
+    for (size_t offset = 0; offset < len && !r; ) {
+        int n = 0;
+        for (; n < nthreads && offset < len; n++, offset += BLOCK_SIZE) {
+            block *b = &ctx->blocks[n];
+            b->in = in + offset;
+            b->len_in = len - offset < BLOCK_SIZE ? len - offset : BLOCK_SIZE;
+            b->max_nbits = ctx->max_nbits;
+            b->streams = ctx->context ? 1 : ctx->streams;
+            b->context = ctx->context;
+            b->fast = ctx->fast;
+        }
+        r = block_encode_all(ctx->blocks, n, nthreads);
+        for (int i = 0; i < n && !r; i++) {
+            const block *b = &ctx->blocks[i];
+            r = _libah_reserve(ctx, pos + 2 * COUNT_SIZE + b->len_out + COUNT_SIZE);
+            if (r) break;
+            unsigned int len_in = b->len_in, len_enc = b->len_out;
+            memcpy(ctx->out + pos, &len_in, COUNT_SIZE);
+            memcpy(ctx->out + pos + COUNT_SIZE, &len_enc, COUNT_SIZE);
+            memcpy(ctx->out + pos + 2 * COUNT_SIZE, b->out, b->len_out);
+            pos += 2 * COUNT_SIZE + b->len_out;
+        }
+    }
+    if (r) return r;
+    // The end mark, there is always room for it
+    memset(ctx->out + pos, 0, COUNT_SIZE);
+    *out = ctx->out;
+    *len_out = pos + COUNT_SIZE;
+    return OK;
+}
+
+/*
+ * Compress the len bytes of in. The output is set in out, with
+ * len_out bytes, and it's valid until the next call with ctx.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int ah_compress_buffer(ah_ctx *ctx, const unsigned char *in, size_t len,
+                       const unsigned char **out, size_t *len_out) {
+    return ctx->error = _libah_compress(ctx, in, len, out, len_out);
+}
+
+/* Decode the adaptive codes of in */
+int _libah_decompress_adaptive(ah_ctx *ctx, const unsigned char *in, size_t len,
+                               size_t *len_out) {
+    if (!ctx->model && !(ctx->model = (adapt_model *) malloc(sizeof(adapt_model)))) {
+        return ERROR_MEM;
+    }
+    adapt_init(ctx->model);
+    bitreader br;
+    bitreader_init_mem(&br, in, len);
+    size_t pos = 0;
+    int symb, r;
+    while (!(r = adapt_decode(ctx->model, &br, &symb)) && symb != ADAPT_END) {
+        if (pos == ctx->size_out && (r = _libah_reserve(ctx, pos + 1))) break;
+        ctx->out[pos++] = symb;
+    }
+    *len_out = pos;
+    return r;
+}
+
+/* Decompress the input, see ah_decompress_buffer */
+int _libah_decompress(ah_ctx *ctx, const unsigned char *in, size_t len,
+                      const unsigned char **out, size_t *len_out) {
+    if (len < HEADER_SIZE || memcmp(in, MAGIC_NUMBER, MAGIC_NUMBER_SIZE)
+            || ah_check_header_flags(in + MAGIC_NUMBER_SIZE)) {
+        return INVALID_FILE_IN;
+    }
+    unsigned char flags = in[MAGIC_NUMBER_SIZE + 1];
+    int r = _libah_reserve(ctx, 1);
+    if (r) return r;
+    *out = ctx->out;
+    if (flags & HEADER_FLAG_ADAPTIVE) {
+        r = _libah_decompress_adaptive(ctx, in + HEADER_SIZE, len - HEADER_SIZE, len_out);
+        *out = ctx->out;
+        return r;
+    }
+    unsigned int block_size;
+    if (!(flags & HEADER_FLAG_BLOCKS) || len < HEADER_SIZE + COUNT_SIZE) {
+        return INVALID_FILE_IN;
+    }
+    memcpy(&block_size, in + HEADER_SIZE, COUNT_SIZE);
+    if (block_size == 0 || block_size > MAX_BLOCK_SIZE) {
+        return INVALID_FILE_IN;
+    }
+    // Check the blocks, and the size of the output
+    const unsigned char *first = in + HEADER_SIZE + COUNT_SIZE, *p = first, *end = in + len;
+    size_t total = 0;
+    while (TRUE) {
+        unsigned int len_raw, len_enc;
+        if ((size_t) (end - p) < COUNT_SIZE) return INVALID_FILE_IN;
+        memcpy(&len_raw, p, COUNT_SIZE);
+        p += COUNT_SIZE;
+        if (len_raw == 0) break;
+        if (len_raw > block_size || (size_t) (end - p) < COUNT_SIZE) return INVALID_FILE_IN;
+        memcpy(&len_enc, p, COUNT_SIZE);
+        p += COUNT_SIZE;
+        if ((size_t) (end - p) < len_enc || len_enc > block_max_encoded(len_raw)) {
+            return INVALID_FILE_IN;
+        }
+        p += len_enc;
+        total += len_raw;
+    }
+    r = _libah_blocks(ctx);
+    if (!r) r = _libah_reserve(ctx, total);
+    if (r) return r;
+    int nthreads = ctx->nblocks;
+    size_t pos = 0;
+    p = first;
+    while (pos < total && !r) {
+        int n = 0;
+        for (; n < nthreads; n++) {
+            unsigned int len_raw, len_enc;
+            memcpy(&len_raw, p, COUNT_SIZE);
+            if (len_raw == 0) break;
+            memcpy(&len_enc, p + COUNT_SIZE, COUNT_SIZE);
+            block *b = &ctx->blocks[n];
+            b->in = p + 2 * COUNT_SIZE;
+            b->len_in = len_enc;
+            b->len_out = len_raw;
+            b->stored = flags & HEADER_FLAG_STORED && len_enc == len_raw;
+            b->streams = flags & HEADER_FLAG_STREAMS ? CODEC_STREAMS : 1;
+            b->context = flags & HEADER_FLAG_CONTEXT ? TRUE : FALSE;
+            p += 2 * COUNT_SIZE + len_enc;
+        }
+        r = block_decode_all(ctx->blocks, n, nthreads, &ctx->tables);
+        for (int i = 0; i < n && !r; i++) {
+            memcpy(ctx->out + pos, ctx->blocks[i].out, ctx->blocks[i].len_out);
+            pos += ctx->blocks[i].len_out;
+        }
+    }
+    *out = ctx->out;
+    *len_out = pos;
+    return r;
+}
+
+/*
+ * Decompress the len bytes of in, compressed in blocks or with
+ * the adaptive codes (the formats without blocks of the version
+ * 1 and 2 are not supported). The output is set in out, with
+ * len_out bytes, and it's valid until the next call with ctx.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int ah_decompress_buffer(ah_ctx *ctx, const unsigned char *in, size_t len,
+                         const unsigned char **out, size_t *len_out) {
+    return ctx->error = _libah_decompress(ctx, in, len, out, len_out);
+}
+
+
+#define STREAM_HEADER       0   /* States of a stream: the header of the file */
+#define STREAM_BLOCK_SIZE   1   /* The size of the blocks (to decode) */
+#define STREAM_BLOCKS       2   /* The raw length of the next block */
+#define STREAM_LEN_ENC      3   /* The encoded length of the block (to decode) */
+#define STREAM_PAYLOAD      4   /* The encoded data of the block (to decode) */
+#define STREAM_DONE         5   /* After the end mark */
+
+/*
+ * Create a stream to compress, or to decompress if
+ * decode is not 0, with the default options.
+ * Return NULL if there is no memory.
+ */
+ah_stream *ah_stream_create(int decode) {
+    ah_stream *s = (ah_stream *) malloc(sizeof(ah_stream));
+    if (!s) return NULL;
+    s->max_nbits = MAX_CODE_NBITS;
+    s->streams = 1;
+    s->context = FALSE;
+    s->fast = FALSE;
+    s->max_block_size = BLOCK_SIZE;
+    s->decode = decode ? TRUE : FALSE;
+    s->state = STREAM_HEADER;
+    block_init(&s->b);
+    block_tables_init(&s->tables);
+    s->acc = NULL;
+    s->len_acc = 0;
+    s->size_acc = 0;
+    s->len_head = 0;
+    s->pos_head = 0;
+    s->body = NULL;
+    s->len_body = 0;
+    s->pos_body = 0;
+    s->block_size = 0;
+    s->len_raw = 0;
+    s->len_enc = 0;
+    s->flags = 0;
+    s->error = OK;
+    return s;
+}
+
+/*
+ * Free the stream and its buffers.
+ */
+void ah_stream_free(ah_stream *s) {
+    if (!s) return;
+    block_free(&s->b);
+    block_tables_free(&s->tables);
+    free(s->acc);
+    free(s);
+}
+
+/*
+ * Set an option of the stream (AH_OPT_*, except AH_OPT_THREADS),
+ * before the first call to ah_stream_encode or ah_stream_decode.
+ * Return 0 if no errors, or AH_ERROR_PARAM if the option or
+ * the value are not valid.
+ */
+int ah_stream_set_option(ah_stream *s, int option, int value) {
+    return _libah_set_option(option, value, NULL, &s->max_nbits,
+                             &s->streams, &s->context, &s->fast,
+                             &s->max_block_size);
+}
+
+/*
+ * Return the error code of the stream, 0 if no errors
+ * (see ah_strerror).
+ */
+int ah_stream_error(const ah_stream *s) {
+    return s->error;
+}
+
+/*
+ * Copy into out the bytes of src from *pos, as many as fit in out.
+ * Return TRUE if all the bytes of src were copied.
+ */
+int _ah_stream_copy(unsigned char *out, size_t out_cap, size_t *out_len,
+                    const unsigned char *src, size_t len, size_t *pos) {
+    size_t n = len - *pos;
+    if (n > out_cap - *out_len) n = out_cap - *out_len;
+    if (n > 0) {
+        memcpy(out + *out_len, src + *pos, n);
+        *pos += n;
+        *out_len += n;
+    }
+    return *pos == len;
+}
+
+/*
+ * Take bytes of the input into the head of the stream, until it
+ * has n bytes. Return TRUE when it has them, to read them.
+ */
+int _ah_stream_take(ah_stream *s, const unsigned char *in, size_t in_len,
+                    size_t *in_used, size_t n) {
+    size_t m = n - s->len_head;
+    if (m > in_len - *in_used) m = in_len - *in_used;
+    if (m > 0) {
+        memcpy(s->head + s->len_head, in + *in_used, m);
+        s->len_head += m;
+        *in_used += m;
+    }
+    if (s->len_head < n) {
+        return FALSE;
+    }
+    s->len_head = 0;
+    return TRUE;
+}
+
+/* Encode len bytes of in as a block, to write it with its header */
+int _ah_stream_encode_block(ah_stream *s, const unsigned char *in, size_t len) {
+    s->b.in = in;
+    s->b.len_in = len;
+    int r = s->b.context ? block_encode_context(&s->b) : block_encode(&s->b);
+    if (r) return r;
+    unsigned int len_in = len, len_enc = s->b.len_out;
+    memcpy(s->head, &len_in, COUNT_SIZE);
+    memcpy(s->head + COUNT_SIZE, &len_enc, COUNT_SIZE);
+    s->len_head = 2 * COUNT_SIZE;
+    s->pos_head = 0;
+    s->body = s->b.out;
+    s->len_body = s->b.len_out;
+    s->pos_body = 0;
+    return OK;
+}
+
+/*
+ * Compress the in_len bytes of in, writing up to out_cap bytes
+ * of compressed data in out. The bytes of the input consumed are
+ * set in in_used, and the bytes written in out_len: the input not
+ * consumed, because out is full, has to be passed again in the
+ * next call. With AH_FLUSH the input received is encoded even if
+ * the block is not full, and with AH_FINISH the stream is ended:
+ * the calls have to be repeated with AH_FINISH until all the
+ * output is written.
+ * Return 0 if no errors, AH_STREAM_END if the stream was ended
+ * and written completely, otherwise an error code.
+ */
+int ah_stream_encode(ah_stream *s, const unsigned char *in, size_t in_len,
+                     size_t *in_used, unsigned char *out, size_t out_cap,
+                     size_t *out_len, int flush) {
+    *in_used = 0;
+    *out_len = 0;
+    if (s->error) return s->error;
+    if (s->decode) return ERROR_PARAM;
+    int r = OK;
+    while (!r) {
+        if (!_ah_stream_copy(out, out_cap, out_len, s->head, s->len_head, &s->pos_head)
+                || !_ah_stream_copy(out, out_cap, out_len, s->body, s->len_body, &s->pos_body)) {
+            break;              // out is full
+        }
+        if (s->state == STREAM_DONE) {
+            r = AH_STREAM_END;
+            break;
+        }
+        if (s->state == STREAM_HEADER) {
+            unsigned int block_size = BLOCK_SIZE;
+            memcpy(s->head, MAGIC_NUMBER, MAGIC_NUMBER_SIZE);
+            s->head[MAGIC_NUMBER_SIZE] = VERSION_BYTE;
+            s->head[MAGIC_NUMBER_SIZE + 1] = HEADER_FLAG_BLOCKS | HEADER_FLAG_STORED
+                    | (s->context ? HEADER_FLAG_CONTEXT
+                       : s->streams > 1 ? HEADER_FLAG_STREAMS : 0);
+            memcpy(s->head + HEADER_SIZE, &block_size, COUNT_SIZE);
+            s->len_head = HEADER_SIZE + COUNT_SIZE;
+            s->pos_head = 0;
+            s->b.max_nbits = s->max_nbits;
+            s->b.streams = s->context ? 1 : s->streams;
+            s->b.context = s->context;
+            s->b.fast = s->fast;
+            s->state = STREAM_BLOCKS;
+            continue;
+        }
+        size_t avail = in_len - *in_used;
+        if (s->len_acc == 0 && avail >= BLOCK_SIZE) {
+            // A whole block in the input, encoded without copying it
+            r = _ah_stream_encode_block(s, in + *in_used, BLOCK_SIZE);
+            *in_used += BLOCK_SIZE;
+            continue;
+        }
+        if (avail > 0) {
+            r = block_reserve(&s->acc, &s->size_acc, BLOCK_SIZE);
+            if (r) break;
+            size_t n = BLOCK_SIZE - s->len_acc < avail ? BLOCK_SIZE - s->len_acc : avail;
+            memcpy(s->acc + s->len_acc, in + *in_used, n);
+            s->len_acc += n;
+            *in_used += n;
+        }
+        if (s->len_acc == BLOCK_SIZE
+                || (s->len_acc > 0 && flush != AH_NO_FLUSH && *in_used == in_len)) {
+            r = _ah_stream_encode_block(s, s->acc, s->len_acc);
+            s->len_acc = 0;
+        } else if (flush == AH_FINISH && *in_used == in_len) {
+            memset(s->head, 0, COUNT_SIZE);     // The end mark
+            s->len_head = COUNT_SIZE;
+            s->pos_head = 0;
+            s->state = STREAM_DONE;
+        } else {
+            break;              // All the input consumed
+        }
+    }
+    if (r > AH_STREAM_END) s->error = r;
+    return r;
+}
+
+/*
+ * Decompress the in_len bytes of in, writing up to out_cap bytes
+ * of decompressed data in out. The blocks larger than the option
+ * AH_OPT_MAX_BLOCK_SIZE are rejected as invalid. The bytes of the input consumed
+ * are set in in_used, and the bytes written in out_len: the input
+ * not consumed, because out is full, has to be passed again in the
+ * next call. Only data compressed in blocks is supported.
+ * Return 0 if no errors, AH_STREAM_END if the end of the compressed
+ * data was found and all the output written (the rest of the input
+ * is consumed, e.g. the seek index), otherwise an error code.
+ */
+int ah_stream_decode(ah_stream *s, const unsigned char *in, size_t in_len,
+                     size_t *in_used, unsigned char *out, size_t out_cap,
+                     size_t *out_len) {
+    *in_used = 0;
+    *out_len = 0;
+    if (s->error) return s->error;
+    if (!s->decode) return ERROR_PARAM;
+    int r = OK;
+    while (!r) {
+        if (!_ah_stream_copy(out, out_cap, out_len, s->body, s->len_body, &s->pos_body)) {
+            break;              // out is full
+        }
+        if (s->state == STREAM_HEADER) {
+            if (!_ah_stream_take(s, in, in_len, in_used, HEADER_SIZE)) break;
+            s->flags = s->head[MAGIC_NUMBER_SIZE + 1];
+            if (memcmp(s->head, MAGIC_NUMBER, MAGIC_NUMBER_SIZE)
+                    || ah_check_header_flags(s->head + MAGIC_NUMBER_SIZE)
+                    || !(s->flags & HEADER_FLAG_BLOCKS)) {
+                r = INVALID_FILE_IN;
+                break;
+            }
+            s->b.streams = s->flags & HEADER_FLAG_STREAMS ? CODEC_STREAMS : 1;
+            s->b.context = s->flags & HEADER_FLAG_CONTEXT ? TRUE : FALSE;
+            s->state = STREAM_BLOCK_SIZE;
+        } else if (s->state == STREAM_BLOCK_SIZE) {
+            if (!_ah_stream_take(s, in, in_len, in_used, COUNT_SIZE)) break;
+            memcpy(&s->block_size, s->head, COUNT_SIZE);
+            if (s->block_size == 0 || s->block_size > s->max_block_size) {
+                r = INVALID_FILE_IN;
+                break;
+            }
+            s->state = STREAM_BLOCKS;
+        } else if (s->state == STREAM_BLOCKS) {
+            if (!_ah_stream_take(s, in, in_len, in_used, COUNT_SIZE)) break;
+            memcpy(&s->len_raw, s->head, COUNT_SIZE);
+            if (s->len_raw > s->block_size) {
+                r = INVALID_FILE_IN;
+                break;
+            }
+            s->state = s->len_raw ? STREAM_LEN_ENC : STREAM_DONE;
+        } else if (s->state == STREAM_LEN_ENC) {
+            if (!_ah_stream_take(s, in, in_len, in_used, COUNT_SIZE)) break;
+            memcpy(&s->len_enc, s->head, COUNT_SIZE);
+            if (s->len_enc > block_max_encoded(s->len_raw)) {
+                r = INVALID_FILE_IN;
+                break;
+            }
+            s->state = STREAM_PAYLOAD;
+        } else if (s->state == STREAM_PAYLOAD) {
+            size_t avail = in_len - *in_used;
+            if (s->len_acc == 0 && avail >= s->len_enc) {
+                // The whole block in the input, decoded without copying it
+                s->b.in = in + *in_used;
+                *in_used += s->len_enc;
+            } else {
+                r = block_reserve(&s->acc, &s->size_acc, s->len_enc);
+                if (r) break;
+                size_t n = s->len_enc - s->len_acc < avail ? s->len_enc - s->len_acc : avail;
+                memcpy(s->acc + s->len_acc, in + *in_used, n);
+                s->len_acc += n;
+                *in_used += n;
+                if (s->len_acc < s->len_enc) break;
+                s->b.in = s->acc;
+                s->len_acc = 0;
+            }
+            s->b.len_in = s->len_enc;
+            s->b.len_out = s->len_raw;
+            s->b.stored = s->flags & HEADER_FLAG_STORED && s->len_enc == s->len_raw;
+            r = block_decode_all(&s->b, 1, 1, &s->tables);
+            s->body = s->b.out;
+            s->len_body = s->len_raw;
+            s->pos_body = 0;
+            s->state = STREAM_BLOCKS;
+        } else {
+            *in_used = in_len;  // After the end mark, e.g. the seek index
+            r = AH_STREAM_END;
+        }
+    }
+    if (r > AH_STREAM_END) s->error = r;
+    return r;
+}
+
+/*
+ * Check the two bytes of flags of a header: the version of the
+ * format and the flags of the second byte.
+ * Return 0 if they are supported, otherwise INVALID_FILE_IN.
+ */
+int ah_check_header_flags(const unsigned char flags[2]) {
+    if (flags[0] != VERSION_BYTE && flags[0] != VERSION_BYTE_V1) {
+        return INVALID_FILE_IN;     // Different version not supported?
+    }
+    if (flags[1] & ~(HEADER_FLAG_BLOCKS | HEADER_FLAG_STREAMS | HEADER_FLAG_INDEX
+                     | HEADER_FLAG_ADAPTIVE | HEADER_FLAG_CONTEXT | HEADER_FLAG_STORED)
+            || (flags[1] && flags[0] == VERSION_BYTE_V1)
+            || (flags[1] & (HEADER_FLAG_STREAMS | HEADER_FLAG_INDEX | HEADER_FLAG_CONTEXT
+                            | HEADER_FLAG_STORED)
+                && !(flags[1] & HEADER_FLAG_BLOCKS))
+            || (flags[1] & HEADER_FLAG_CONTEXT && flags[1] & HEADER_FLAG_STREAMS)
+            || (flags[1] & HEADER_FLAG_ADAPTIVE && flags[1] != HEADER_FLAG_ADAPTIVE)) {
+        return INVALID_FILE_IN;     // New flags not supported?
+    }
+    return OK;
+}
+
+/*
+ * Return a message that describes the error code, to print it
+ * or log it. The codec functions never end the process, they
+ * return these codes.
+ */
+const char *ah_strerror(int error_code) {
+    switch (error_code) {
+        case OK: return "Success";
+        case ERROR_MEM: return "Insufficient memory";
+        case ERROR_PARAM: return "Invalid parameter";
+        case ERROR_FILE_NOT_FOUND: return "The input file cannot be opened";
+        case ERROR_FILE_OUT: return "The output cannot be written";
+        case INVALID_FILE_IN: return "The input is not valid";
+        case INVALID_BITS_SIZE: return "Number of bits used by a symbol too high";
+        case INVALID_CPU: return "Instruction set not supported by the CPU";
+        case ERROR_THREAD: return "A thread cannot be created";
+        case ERROR_READ: return "The input cannot be read";
+        default: return "Unknown error";
+    }
+}
@@ -0,0 +1,199 @@
+/* libah.h
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef __AH_LIBAH_H
+#define __AH_LIBAH_H
+
+
+#include <stddef.h>
+
+
+/* The functions of the library, the only symbols it exports */
+#if defined(__GNUC__)
+#define AH_EXPORT   __attribute__((visibility("default")))
+#else
+#define AH_EXPORT
+#endif
+
+
+/*
+ * Context to compress and decompress buffers in memory with the
+ * format of the files, that keeps its buffers and tables between
+ * calls: create one with ah_ctx_create and use it for many calls,
+ * so after the first calls nothing is allocated again, unless the
+ * data is bigger. The input of a call can't be the output of the
+ * previous call with the same context. A context can be used by
+ * one thread at once, but different contexts can be used at the
+ * same time. The functions never end the process, the errors are
+ * returned as codes.
+ */
+typedef struct _ah_ctx ah_ctx;
+
+/*
+ * State of an incremental compression or decompression, that
+ * receives the input and delivers the output in chunks of any
+ * size, as they arrive (e.g. from the network). The data is
+ * processed block by block, so at most a block of the input
+ * and a block of the output are kept: a block is taken
+ * directly from the input passed, without copying it, when
+ * it's all there.
+ */
+typedef struct _ah_stream ah_stream;
+
+
+#define AH_OPT_THREADS          1   /* Number of threads to use (default 1,
+                                       only with ah_ctx) */
+#define AH_OPT_MAX_CODE_LEN     2   /* Max length in bits of the Huffman
+                                       codes (default 12), raised to the
+                                       bits needed to number the symbols of
+                                       each block if lower */
+#define AH_OPT_INTERLEAVE       3   /* If not 0 the codes of each block are
+                                       split in 4 streams (default 0) */
+#define AH_OPT_CONTEXT          4   /* If not 0 the blocks are encoded with
+                                       order-1 contexts (default 0) */
+#define AH_OPT_FAST             5   /* If not 0 the tables are built from
+                                       samples of the blocks (default 0) */
+#define AH_OPT_MAX_BLOCK_SIZE   6   /* Max size in bytes of the blocks that
+                                       ah_stream_decode accepts, to bound
+                                       its memory (default 1 MB, the size
+                                       of the blocks written, only with
+                                       ah_stream) */
+
+#define AH_OK                   0   /* Error codes returned, the same */
+#define AH_ERROR_MEM            2   /* than the exit codes of the command */
+#define AH_ERROR_PARAM          3
+#define AH_INVALID_FILE_IN      7
+#define AH_INVALID_BITS_SIZE    8
+#define AH_ERROR_THREAD         10
+
+#define AH_NO_FLUSH     0       /* Keep the input until a block is full */
+#define AH_FLUSH        1       /* Encode the input received until now */
+#define AH_FINISH       2       /* Encode the rest of the input, and
+                                   end the stream */
+#define AH_STREAM_END   1       /* Returned when the stream is complete */
+
+
+/*
+ * Create a context with the default options.
+ * Return NULL if there is no memory.
+ */
+AH_EXPORT ah_ctx *ah_ctx_create(void);
+
+/*
+ * Free the context and its buffers.
+ */
+AH_EXPORT void ah_ctx_free(ah_ctx *ctx);
+
+/*
+ * Set an option of the context (AH_OPT_*, except
+ * AH_OPT_MAX_BLOCK_SIZE), that can be changed between calls.
+ * Return 0 if no errors, or AH_ERROR_PARAM if the option or
+ * the value are not valid.
+ */
+AH_EXPORT int ah_ctx_set_option(ah_ctx *ctx, int option, int value);
+
+/*
+ * Return the error code of the last call with the context,
+ * 0 if no errors (see ah_strerror).
+ */
+AH_EXPORT int ah_ctx_error(const ah_ctx *ctx);
+
+/*
+ * Compress the len bytes of in. The output is set in out, with
+ * len_out bytes, and it's valid until the next call with ctx.
+ * Return 0 if no errors, otherwise an error code.
+ */
+AH_EXPORT int ah_compress_buffer(ah_ctx *ctx, const unsigned char *in, size_t len,
+                                 const unsigned char **out, size_t *len_out);
+
+/*
+ * Decompress the len bytes of in, compressed in blocks or with
+ * the adaptive codes (the formats without blocks of the version
+ * 1 and 2 are not supported). The output is set in out, with
+ * len_out bytes, and it's valid until the next call with ctx.
+ * Return 0 if no errors, otherwise an error code.
+ */
+AH_EXPORT int ah_decompress_buffer(ah_ctx *ctx, const unsigned char *in, size_t len,
+                                   const unsigned char **out, size_t *len_out);
+
+/*
+ * Create a stream to compress, or to decompress if
+ * decode is not 0, with the default options.
+ * Return NULL if there is no memory.
+ */
+AH_EXPORT ah_stream *ah_stream_create(int decode);
+
+/*
+ * Free the stream and its buffers.
+ */
+AH_EXPORT void ah_stream_free(ah_stream *s);
+
+/*
+ * Set an option of the stream (AH_OPT_*, except AH_OPT_THREADS),
+ * before the first call to ah_stream_encode or ah_stream_decode.
+ * Return 0 if no errors, or AH_ERROR_PARAM if the option or
+ * the value are not valid.
+ */
+AH_EXPORT int ah_stream_set_option(ah_stream *s, int option, int value);
+
+/*
+ * Return the error code of the stream, 0 if no errors
+ * (see ah_strerror).
+ */
+AH_EXPORT int ah_stream_error(const ah_stream *s);
+
+/*
+ * Compress the in_len bytes of in, writing up to out_cap bytes
+ * of compressed data in out. The bytes of the input consumed are
+ * set in in_used, and the bytes written in out_len: the input not
+ * consumed, because out is full, has to be passed again in the
+ * next call. With AH_FLUSH the input received is encoded even if
+ * the block is not full, and with AH_FINISH the stream is ended:
+ * the calls have to be repeated with AH_FINISH until all the
+ * output is written.
+ * Return 0 if no errors, AH_STREAM_END if the stream was ended
+ * and written completely, otherwise an error code.
+ */
+AH_EXPORT int ah_stream_encode(ah_stream *s, const unsigned char *in, size_t in_len,
+                               size_t *in_used, unsigned char *out, size_t out_cap,
+                               size_t *out_len, int flush);
+
+/*
+ * Decompress the in_len bytes of in, writing up to out_cap bytes
+ * of decompressed data in out. The blocks larger than the option
+ * AH_OPT_MAX_BLOCK_SIZE are rejected as invalid. The bytes of the input consumed
+ * are set in in_used, and the bytes written in out_len: the input
+ * not consumed, because out is full, has to be passed again in the
+ * next call. Only data compressed in blocks is supported.
+ * Return 0 if no errors, AH_STREAM_END if the end of the compressed
+ * data was found and all the output written (the rest of the input
+ * is consumed, e.g. the seek index), otherwise an error code.
+ */
+AH_EXPORT int ah_stream_decode(ah_stream *s, const unsigned char *in, size_t in_len,
+                               size_t *in_used, unsigned char *out, size_t out_cap,
+                               size_t *out_len);
+
+/*
+ * Return the message of the error code.
+ */
+AH_EXPORT const char *ah_strerror(int error_code);
+
+
+#endif /* __AH_LIBAH_H */
@@ -23,13 +23,40 @@
 #include <getopt.h>
 #include <ctype.h>
 #include <signal.h>
+#include <unistd.h>
 #include "const.h"
 #include "freqlist.h"
 #include "ah.h"
+#include "codec.h"
+#include "hist.h"
 #include "util.h"
 
 
-#define USAGE   "Usage: %s [-dcvh] [FILE]\n" \
+#define OPT_CPU         256     /* Long options without a short option */
+#define OPT_MAX_CODE    257
+#define OPT_INTERLEAVE  258
+#define OPT_INDEX       259
+#define OPT_RANGE       260
+#define OPT_ADAPTIVE    261
+#define OPT_CONTEXT     262
+#define OPT_FAST        263
+
+static struct option long_options[] = {
+    {"cpu", required_argument, NULL, OPT_CPU},
+    {"max-code-len", required_argument, NULL, OPT_MAX_CODE},
+    {"interleave", no_argument, NULL, OPT_INTERLEAVE},
+    {"index", no_argument, NULL, OPT_INDEX},
+    {"range", required_argument, NULL, OPT_RANGE},
+    {"adaptive", no_argument, NULL, OPT_ADAPTIVE},
+    {"context", no_argument, NULL, OPT_CONTEXT},
+    {"fast", no_argument, NULL, OPT_FAST},
+    {NULL, 0, NULL, 0}
+};
+
+
+#define USAGE   "Usage: %s [-dcvh] [-T N] [--max-code-len=N] [--interleave]\n" \
+                "          [--index] [--range=OFFSET:LEN] [--adaptive] [--context]\n" \
+                "          [--fast] [--cpu=KERNEL] [FILE]\n" \
                 "Compress or uncompress FILE using Huffman encoding " \
                 "(by default, compress FILE in-place).\n" \
                 "\n" \
@@ -38,29 +65,58 @@
                 "  -d       decompress\n" \
                 "  -v       verbose mode, print the frequency table (if compressing)\n" \
                 "           and the binary tree used in the encryption\n" \
+                "  -T N     use N threads to count, compress and decompress\n" \
                 "  -h       display this help and exit\n" \
+                "  --max-code-len=N\n" \
+                "           max length in bits of the Huffman codes (default: 12),\n" \
+                "           raised to the bits needed to number the symbols of\n" \
+                "           the input if lower (8 when all the 256 bytes are used)\n" \
+                "  --interleave\n" \
+                "           split the codes of each block in 4 streams,\n" \
+                "           that are faster to decompress\n" \
+                "  --index  add a seek index at the end, to decompress\n" \
+                "           ranges of the data without decoding it all\n" \
+                "  --range=OFFSET:LEN\n" \
+                "           decompress only LEN bytes from the byte OFFSET\n" \
+                "  --adaptive\n" \
+                "           compress in one pass with adaptive Huffman codes,\n" \
+                "           writing the output while the input is read\n" \
+                "           (not with --interleave, --index, --context or --fast)\n" \
+                "  --context\n" \
+                "           use order-1 codes, with a table for each previous\n" \
+                "           byte in each block (codes of 12 bits at most)\n" \
+                "  --fast   build the table of each block from a sample of it,\n" \
+                "           compressing in one pass (not with --context)\n" \
+                "  --cpu=KERNEL\n" \
+                "           instruction set used to count the symbols: scalar,\n" \
+                "           sse2, avx2 or avx512 (default: the widest supported)\n" \
                 "\n" \
                 "With no FILE, or when FILE is -, read standard input.\n" \
                 "\"Another Huffman\" encoder project v3.1b1: ah <https://github.com/mrsarm/ah>\n"
 
 
-/* Initialize the global variables with the command arguments */
+/* Initialize the data with the command arguments */
 ah_data* init_options(int argc, char *argv[]);
 
 /* Ctrl+C handler */
 void ctrlc_handler(int sig);
 
+/* Build and print the Huffman codes */
+void build_codes(ah_data *data);
 /* Compress input */
-void compress();
+void compress(ah_data *data);
 /* Decompress input */
-void decompress();
+void decompress(ah_data *data);
 
-ah_data* data;
+/* Data of the command, only to be reached by the Ctrl+C handler:
+   the codec functions get it as argument and don't use globals */
+static ah_data* ctrlc_data;
 
 int main(int argc, char *argv[])
 {
+    ah_data* data = init_options(argc, argv);           // Initialize data with the command arguments
+    ctrlc_data = data;
     signal(SIGINT, ctrlc_handler);                      // Initialize Ctrl+C signal
-    data = init_options(argc, argv);                    // Initialize data with the command arguments
 
     int r = ah_data_init_resources(data);               // Initialize resources (files)
     switch (r) {
@@ -77,38 +133,58 @@ int main(int argc, char *argv[])
             error_unknown_code(r, "ah_data_init_resources", (void*)ah_data_free_resources, data);
     }
     if (data->decompres) {
-        decompress();                                   // Decompress input into output
+        decompress(data);                               // Decompress input into output
     } else {
-        compress();                                     // Compress input into output
+        compress(data);                                 // Compress input into output
     }
 
+    signal(SIGINT, SIG_DFL);                            // Nothing to cancel, data is freed
     ah_data_free_resources(data);                       // Close file and free memory
     return 0;
 }
 
+/*
+ * Build the Huffman tree and codes of the symbols counted,
+ * and print them in verbose mode.
+ */
+void build_codes(ah_data *data) {
+    int r = ah_build_codes(data);
+    if (r == ERROR_MEM)
+        error_mem((void*)ah_data_free_resources, data);
+    if (data->verbose) {
+        freqlist_fprintf(stderr, VERBOSE_TABLE, data->freql);
+        fprintf(stderr, "\n");
+        freqlist_fprintf_tree(stderr, VERBOSE_TREE, data->freql);
+    }
+}
+
 /* Compress input */
-void compress() {
-    int r = ah_count(data);                             // Count the symbols
+void compress(ah_data *data) {
+    // Each block counts its symbols to encode them, so the input is only
+    // counted before to print the table, otherwise ah_encode counts it
+    int r = data->verbose ? ah_count(data) : OK;        // Count the symbols
     switch (r) {
         case OK: break;
         case ERROR_MEM:
             error_mem((void*)ah_data_free_resources, data);
+        case ERROR_THREAD:
+            fatal(r, "Error: cannot create thread.\n", (void*)ah_data_free_resources, data);
+        case ERROR_READ:
+            error_invalid_file_in(r, "input", data->filename_in, (void*)ah_data_free_resources, data);
         default:
             error_unknown_code(r, "ah_count", (void*)ah_data_free_resources, data);
     }
 
-    r = freqlist_build_huff(data->freql);               // Build Huffman tree
-    if (r == ERROR_MEM)
-        error_mem((void*)ah_data_free_resources, data);
-    if (data->verbose) {
-        freqlist_fprintf(stderr, VERBOSE_TABLE, data->freql);
-        fprintf(stderr, "\n");
-        freqlist_fprintf_tree(stderr, VERBOSE_TREE, data->freql);
+    if (data->counted) {
+        build_codes(data);                              // Build Huffman tree and codes
     }
 
     r = ah_encode(data);                            // Encode and write
     switch (r) {
         case OK:
+            if (data->verbose && !data->counted && !data->adaptive) {
+                build_codes(data);                      // Counted while encoding
+            }
             if (data->verbose) {
                 fprintf(stderr, "\n");
                 ah_fprintf_summary(stderr, data);
@@ -118,6 +194,12 @@ void compress() {
             error_mem((void*)ah_data_free_resources, data);
         case INVALID_BITS_SIZE:
             error_invalid_nbits((void*)ah_data_free_resources, data);
+        case ERROR_THREAD:
+            fatal(r, "Error: cannot create thread.\n", (void*)ah_data_free_resources, data);
+        case ERROR_FILE_OUT:
+            fatal(r, "Error: cannot write the output.\n", (void*)ah_data_free_resources, data);
+        case ERROR_READ:
+            error_invalid_file_in(r, "input", data->filename_in, (void*)ah_data_free_resources, data);
         default:
             error_unknown_code(r, "ah_encode", (void*)ah_data_free_resources, data);
     }
@@ -125,7 +207,7 @@ void compress() {
 }
 
 /* Decompress input */
-void decompress() {
+void decompress(ah_data *data) {
     int r = ah_decode(data);
     switch (r) {
         case OK: break;
@@ -135,6 +217,10 @@ void decompress() {
             error_invalid_nbits((void*)ah_data_free_resources, data);
         case INVALID_FILE_IN:
             error_invalid_file_in(r, "input", data->filename_in, (void*)ah_data_free_resources, data);
+        case ERROR_THREAD:
+            fatal(r, "Error: cannot create thread.\n", (void*)ah_data_free_resources, data);
+        case ERROR_FILE_OUT:
+            fatal(r, "Error: cannot write the output.\n", (void*)ah_data_free_resources, data);
         default:
             error_unknown_code(r, "ah_decode", (void*)ah_data_free_resources, data);
     }
@@ -144,13 +230,13 @@ void decompress() {
 }
 
 
-/* Initialize the global variables with the command options */
+/* Initialize the data with the command options */
 ah_data* init_options(int argc, char *argv[]) {
     ah_data* data = ah_data_init();
     if (!data) error_mem(NULL, NULL);
     opterr = 0;
     int c;
-    while ((c = getopt(argc, argv, "dcvh")) != -1) {
+    while ((c = getopt_long(argc, argv, "dcvhT:", long_options, NULL)) != -1) {
         switch (c) {
             case 'h':
                 printf(USAGE, argv[0]);
@@ -164,8 +250,76 @@ ah_data* init_options(int argc, char *argv[]) {
             case 'c':
                 data->fo = stdout;
                 break;
+            case 'T': {
+                char *end;
+                long threads = strtol(optarg, &end, 10);
+                if (!isdigit(optarg[0]) || *end || threads < 1 || threads > MAX_THREADS) {
+                    fprintf(stderr, "Error: invalid number of threads `%s'.\n", optarg);
+                    fprintf(stderr, "Try '%s -h' for more information.\n", argv[0]);
+                    exit(ERROR_PARAM);
+                }
+                data->threads = (int) threads;
+                break;
+            }
+            case OPT_CPU:
+                switch (hist_set_cpu(optarg)) {
+                    case OK: break;
+                    case INVALID_CPU:
+                        fprintf(stderr, "Error: the CPU does not support `%s'.\n", optarg);
+                        exit(INVALID_CPU);
+                    default:
+                        fprintf(stderr, "Error: unknown CPU kernel `%s'.\n", optarg);
+                        fprintf(stderr, "Try '%s -h' for more information.\n", argv[0]);
+                        exit(ERROR_PARAM);
+                }
+                break;
+            case OPT_MAX_CODE: {
+                char *end;
+                long max_nbits = strtol(optarg, &end, 10);
+                if (!isdigit(optarg[0]) || *end || max_nbits < 1 || max_nbits > DECODE_MAX_NBITS) {
+                    fprintf(stderr, "Error: invalid max code length `%s', "
+                                    "it has to be between 1 and %d.\n", optarg, DECODE_MAX_NBITS);
+                    exit(ERROR_PARAM);
+                }
+                data->max_nbits = (unsigned char) max_nbits;
+                break;
+            }
+            case OPT_INTERLEAVE:
+                data->streams = CODEC_STREAMS;
+                break;
+            case OPT_ADAPTIVE:
+                data->adaptive = TRUE;
+                break;
+            case OPT_CONTEXT:
+                data->context = TRUE;
+                break;
+            case OPT_FAST:
+                data->fast = TRUE;
+                break;
+            case OPT_INDEX:
+                data->index = TRUE;
+                break;
+            case OPT_RANGE: {
+                char *end;
+                data->range_offset = strtoul(optarg, &end, 10);
+                int valid = isdigit(optarg[0]) && *end == ':' && isdigit(end[1]);
+                if (valid) {
+                    data->range_length = strtoul(end + 1, &end, 10);
+                    valid = !*end;
+                }
+                if (!valid) {
+                    fprintf(stderr, "Error: invalid range `%s', "
+                                    "it has to be OFFSET:LEN.\n", optarg);
+                    exit(ERROR_PARAM);
+                }
+                data->range = TRUE;
+                break;
+            }
             case '?':
-                if (isprint (optopt)) {
+                if (!optopt || optopt >= OPT_CPU) {
+                    fprintf(stderr, "Unknown option `%s'.\n", argv[optind-1]);
+                    fprintf(stderr, "Try '%s -h' for more information.\n", argv[0]);
+                } else if (isprint (optopt)) {
                     fprintf(stderr, "Unknown option `-%c'.\n", optopt);
                     fprintf(stderr, "Try '%s -h' for more information.\n", argv[0]);
                 } else {
@@ -176,6 +330,18 @@ ah_data* init_options(int argc, char *argv[]) {
                 exit(ERROR_PARAM);
         }
     }
+    if (data->range && !data->decompres) {
+        fprintf(stderr, "Error: --range can only be used to decompress.\n");
+        fprintf(stderr, "Try '%s -h' for more information.\n", argv[0]);
+        exit(ERROR_PARAM);
+    }
+    if (data->adaptive && !data->decompres
+            && (data->streams > 1 || data->index || data->context || data->fast)) {
+        fprintf(stderr, "Error: --adaptive cannot be used with --interleave, "
+                        "--index, --context or --fast.\n");
+        fprintf(stderr, "Try '%s -h' for more information.\n", argv[0]);
+        exit(ERROR_PARAM);
+    }
     for (int index = optind; index < argc; index++) {
         if (!data->filename_in) {
             data->filename_in = argv[index];
@@ -191,28 +357,15 @@ ah_data* init_options(int argc, char *argv[]) {
 
 /* Ctrl+C handler */
 void ctrlc_handler(int sig) {
-    // If canceled and verbose mode is enabled,
-    // the tables and Huffman tree is printed out at least.
-    // If the process didn't start to record in the output
-    // file, no content will be recorded.
-    if (data && data->freql) {
-        if (!data->decompres) {
-            freqlist_sort(data->freql);
-            int r = freqlist_build_huff(data->freql);
-            if (r == ERROR_MEM)
-                error_mem((void*)ah_data_free_resources, data);
-            if (data->verbose) {
-                freqlist_fprintf(stderr, VERBOSE_TABLE, data->freql);
-            }
-        }
-        if (data->verbose) {
-            fprintf(stderr, "\n");
-            freqlist_fprintf_tree(stderr, VERBOSE_TREE, data->freql);
-        }
-        ah_data_free_resources(data);
+    ah_data *data = ctrlc_data;
+    // The threads of the codec may still use the resources of data,
+    // so they are not freed here but released by the exit: only the
+    // output file, that is incomplete, is removed.
+    if (data && data->fo && data->filename_out) {
+        unlink(data->filename_out);
     }
-    fprintf(stderr, "\n");
-    exit(0);
+    write(STDERR_FILENO, "\n", 1);
+    _exit(0);
 }
 
 /*  End program.  */
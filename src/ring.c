@@ -0,0 +1,119 @@
+/* ring.c
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+
+#include <sched.h>
+#include <stdlib.h>
+#include "const.h"
+#include "ring.h"
+
+
+#define RING_SPINS      16      /* Times the CPU is yielded while waiting,
+                                   before blocking */
+
+
+/* Return TRUE if the queue is full (to push) or empty (to pop) */
+int _ring_busy(ring *q, int push) {
+    size_t head = __atomic_load_n(&q->head, __ATOMIC_SEQ_CST);
+    size_t tail = __atomic_load_n(&q->tail, __ATOMIC_SEQ_CST);
+    return push ? tail - head == q->size : tail == head;
+}
+
+/* Wait while the queue is full (to push) or empty (to pop) */
+void _ring_wait(ring *q, int push) {
+    for (int spins = 0; spins < RING_SPINS; spins++) {
+        if (!_ring_busy(q, push)) return;
+        sched_yield();
+    }
+    pthread_mutex_lock(&q->lock);
+    __atomic_store_n(&q->waiting, TRUE, __ATOMIC_SEQ_CST);
+    while (_ring_busy(q, push)) {
+        pthread_cond_wait(&q->changed, &q->lock);
+    }
+    __atomic_store_n(&q->waiting, FALSE, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Wake up the other side, if it's waiting */
+void _ring_signal(ring *q) {
+    if (__atomic_load_n(&q->waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&q->lock);
+        pthread_cond_signal(&q->changed);
+        pthread_mutex_unlock(&q->lock);
+    }
+}
+
+/*
+ * Initialize the queue, with room for at least size items.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int ring_init(ring *q, size_t size) {
+    q->size = 1;
+    while (q->size < size) q->size <<= 1;
+    q->items = (void **) malloc(q->size * sizeof(void *));
+    q->head = 0;
+    q->tail = 0;
+    q->waiting = FALSE;
+    if (!q->items) {
+        return ERROR_MEM;
+    }
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->changed, NULL);
+    return OK;
+}
+
+/*
+ * Free the queue.
+ */
+void ring_free(ring *q) {
+    if (q->items) {
+        pthread_mutex_destroy(&q->lock);
+        pthread_cond_destroy(&q->changed);
+    }
+    free(q->items);
+    q->items = NULL;
+}
+
+/*
+ * Push the item (that can be NULL), waiting if the queue is full.
+ */
+void ring_push(ring *q, void *item) {
+    size_t tail = q->tail;
+    if (tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == q->size) {
+        _ring_wait(q, TRUE);
+    }
+    q->items[tail & (q->size - 1)] = item;
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_SEQ_CST);
+    _ring_signal(q);
+}
+
+/*
+ * Pop the oldest item, waiting if the queue is empty.
+ */
+void *ring_pop(ring *q) {
+    size_t head = q->head;
+    if (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == head) {
+        _ring_wait(q, FALSE);
+    }
+    void *item = q->items[head & (q->size - 1)];
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_SEQ_CST);
+    _ring_signal(q);
+    return item;
+}
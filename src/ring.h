@@ -0,0 +1,71 @@
+/* ring.h
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+
+#ifndef __AH_RING_H
+#define __AH_RING_H
+
+
+#include <stddef.h>
+#include <pthread.h>
+
+
+/*
+ * Bounded queue of pointers between two threads, one that only
+ * pushes and one that only pops, without locks: each side only
+ * changes its own index, and reads the index of the other side
+ * with acquire/release ordering. Waiting for room or for an item
+ * first yields the CPU, and then blocks until the other side
+ * signals the change, which it only does if a side is waiting.
+ */
+typedef struct _ring {
+    void **items;
+    size_t size;                /* Number of items, a power of 2 */
+    size_t head;                /* Items popped, changed by the consumer */
+    size_t tail;                /* Items pushed, changed by the producer */
+    int waiting;                /* TRUE if a side is blocked waiting */
+    pthread_mutex_t lock;       /* Only to block and to signal */
+    pthread_cond_t changed;
+} ring;
+
+
+/*
+ * Initialize the queue, with room for at least size items.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int ring_init(ring *q, size_t size);
+
+/*
+ * Free the queue.
+ */
+void ring_free(ring *q);
+
+/*
+ * Push the item (that can be NULL), waiting if the queue is full.
+ */
+void ring_push(ring *q, void *item);
+
+/*
+ * Pop the oldest item, waiting if the queue is empty.
+ */
+void *ring_pop(ring *q);
+
+
+#endif /* __AH_RING_H */
@@ -0,0 +1,195 @@
+/* spec.c
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "const.h"
+#include "spec.h"
+#include "block.h"
+
+
+/* A chunk of codes, decoded by its own thread */
+typedef struct _spec_chunk {
+    const decode_table *dt;
+    const unsigned char *in;    /* The whole window */
+    size_t len_in;              /* Bytes in in */
+    uint64_t start;             /* Bit where the decoding starts */
+    uint64_t end;               /* Bit where the next chunk starts */
+    uint64_t stop;              /* Bit after the last symbol decoded */
+    unsigned char *out;         /* Symbols decoded */
+    size_t len_out, size_out;
+    size_t skip;                /* Symbols of out decoded before finding
+                                   the boundaries of the codes */
+    uint64_t *bounds;           /* Bit where each of the first symbols starts */
+    size_t nbounds;
+    int error;
+} spec_chunk;
+
+/* Reader of in positioned at bit, with positions relative to in */
+void _spec_reader(bitreader *br, const unsigned char *in, size_t len, uint64_t bit) {
+    bitreader_init_mem(br, in, len);
+    br->pos = bit >> 3;
+    bitreader_refill(br);
+    bitreader_skip(br, bit & 7);
+}
+
+/* Thread body, decode the chunk from its start until its end */
+void *_spec_work(void *arg) {
+    spec_chunk *c = (spec_chunk *) arg;
+    c->len_out = c->skip = 0;
+    // Each code has at least min_nbits bits
+    c->error = block_reserve(&c->out, &c->size_out,
+                             (c->end - c->start) / c->dt->min_nbits + 1);
+    if (c->error) return NULL;
+    bitreader br;
+    _spec_reader(&br, c->in, c->len_in, c->start);
+    c->error = codec_decode_until(c->dt, &br, c->out, c->size_out, c->end,
+                                  c->bounds, SPEC_SYNC_SYMBS, &c->len_out);
+    c->nbounds = c->len_out < SPEC_SYNC_SYMBS ? c->len_out : SPEC_SYNC_SYMBS;
+    if (c->error && c->nbounds < SPEC_SYNC_SYMBS) {
+        c->nbounds++;           // The position of the invalid code too
+    }
+    c->stop = bitreader_tell(&br);
+    return NULL;
+}
+
+/*
+ * Continue the decoding of prev, that ends in the right position, until
+ * it meets a symbol decoded by next, or until the end of next if not.
+ */
+int _spec_sync(spec_chunk *prev, spec_chunk *next) {
+    const decode_table *dt = prev->dt;
+    bitreader br;
+    _spec_reader(&br, prev->in, prev->len_in, prev->stop);
+    size_t j = 0;
+    while (TRUE) {
+        uint64_t pos = bitreader_tell(&br);
+        while (j < next->nbounds && next->bounds[j] < pos) j++;
+        if (j < next->nbounds && next->bounds[j] == pos) {
+            next->skip = j;     // Same boundary, from here the decoding is the same
+            return OK;
+        }
+        if (j == next->nbounds || pos >= next->end) break;
+        int r = block_reserve(&prev->out, &prev->size_out, prev->len_out + 1);
+        if (!r) r = codec_decode(dt, &br, prev->out + prev->len_out, 1);
+        if (r) return r;
+        prev->len_out++;
+    }
+    // Not met, decode the rest of the next chunk here
+    size_t n;
+    uint64_t pos = bitreader_tell(&br);
+    int r = block_reserve(&prev->out, &prev->size_out, prev->len_out + 1
+                          + (pos < next->end ? (next->end - pos) / dt->min_nbits : 0));
+    if (r) return r;
+    r = codec_decode_until(dt, &br, prev->out + prev->len_out,
+                           prev->size_out - prev->len_out, next->end, NULL, 0, &n);
+    prev->len_out += n;
+    next->skip = next->len_out;
+    next->stop = bitreader_tell(&br);
+    next->error = OK;
+    return r;
+}
+
+/* Decode the window with a chunk per thread, the last one in the current thread */
+int _spec_decode_window(spec_chunk *chunks, int nthreads) {
+    pthread_t threads[MAX_THREADS];
+    int started = 0, r = OK;
+    for (int i = 0; i < nthreads - 1; i++, started++) {
+        if (pthread_create(&threads[i], NULL, _spec_work, &chunks[i])) {
+            r = ERROR_THREAD;
+            break;
+        }
+    }
+    if (!r) _spec_work(&chunks[nthreads - 1]);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return r;
+}
+
+/*
+ * Decode n symbols from the single stream of codes read from fi,
+ * writing them into fo, with nthreads threads.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int spec_decode(const decode_table *dt, FILE *fi, FILE *fo, uint64_t n, int nthreads) {
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+    size_t size = (size_t) nthreads * SPEC_CHUNK_SIZE + SPEC_MARGIN;
+    unsigned char *buffer = (unsigned char *) malloc(size);
+    spec_chunk *chunks = (spec_chunk *) calloc(nthreads, sizeof(spec_chunk));
+    uint64_t *bounds = (uint64_t *) malloc(nthreads * SPEC_SYNC_SYMBS * sizeof(uint64_t));
+    int r = buffer && chunks && bounds ? OK : ERROR_MEM;
+    size_t len = 0;             // Bytes in buffer
+    uint64_t start = 0;         // Bit of the buffer where the next code starts
+    int eof = FALSE;
+    while (n && !r) {
+        len += fread(buffer + len, 1, size - len, fi);
+        eof = len < size;
+        // Bits to split in the chunks, the margin is only decoded by the last one
+        size_t limit = eof ? len : len - SPEC_MARGIN;
+        for (int i = 0; i < nthreads; i++) {
+            spec_chunk *c = &chunks[i];
+            c->dt = dt;
+            c->in = buffer;
+            c->len_in = len;
+            c->start = i ? (uint64_t) (limit * i / nthreads) * 8 : start;
+            c->end = (uint64_t) (limit * (i + 1) / nthreads) * 8;
+            if (c->end < c->start) c->end = c->start;
+            c->bounds = bounds + i * SPEC_SYNC_SYMBS;
+        }
+        r = _spec_decode_window(chunks, nthreads);
+        for (int i = 0; i < nthreads && !r; i++) {
+            spec_chunk *c = &chunks[i];
+            // The decoding of c ends in the right position, unless it failed
+            if (!c->error && i < nthreads - 1) {
+                r = _spec_sync(c, &chunks[i + 1]);
+            }
+            size_t m = c->len_out - c->skip;
+            if (m > n) m = n;
+            if (fwrite(c->out + c->skip, SYMBOL_SIZE, m, fo) != m) {
+                r = ERROR_FILE_OUT;
+            }
+            n -= m;
+            if (!n) break;
+            if (!r) r = c->error;
+        }
+        if (r || !n) break;
+        if (eof) {
+            r = INVALID_FILE_IN;        // Less symbols than expected
+            break;
+        }
+        // Keep the codes after the window for the next one
+        uint64_t stop = chunks[nthreads - 1].stop;
+        size_t from = stop >> 3;
+        memmove(buffer, buffer + from, len - from);
+        len -= from;
+        start = stop & 7;
+    }
+    if (chunks) {
+        for (int i = 0; i < nthreads; i++) {
+            free(chunks[i].out);
+        }
+    }
+    free(chunks);
+    free(bounds);
+    free(buffer);
+    return r;
+}
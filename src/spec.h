@@ -0,0 +1,59 @@
+/* spec.h
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef __AH_SPEC_H
+#define __AH_SPEC_H
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include "codec.h"
+
+
+#define SPEC_CHUNK_SIZE     1048576 /* Bytes of codes of the chunk that
+                                       each thread decodes at once */
+#define SPEC_SYNC_SYMBS     4096    /* Symbols of each chunk whose position
+                                       is kept to find where the decoding
+                                       of the previous chunk meets it */
+#define SPEC_MARGIN         16      /* Bytes read after the chunks, to decode
+                                       the codes that end after them */
+
+
+/*
+ * Decode n symbols from the single stream of codes read from fi,
+ * writing them into fo, with nthreads threads.
+ *
+ * The codes are read in windows of nthreads chunks of
+ * SPEC_CHUNK_SIZE bytes, and each thread decodes one of the chunks
+ * from its first bit, although a code may start elsewhere. The
+ * Huffman codes resynchronize quickly, so after a few symbols the
+ * thread finds the real boundaries of the codes: the decoding of
+ * each chunk is continued after its end until it reaches a
+ * position where the next chunk decoded a symbol, and the output
+ * of the next chunk is valid from that symbol. If that does not
+ * happen, the next chunk is decoded again from the right position.
+ * The output is the same as decoding with one thread, but
+ * an input with less codes than n symbols is not valid.
+ * Return 0 if no errors, otherwise an error code.
+ */
+int spec_decode(const decode_table *dt, FILE *fi, FILE *fo, uint64_t n, int nthreads);
+
+
+#endif /* __AH_SPEC_H */
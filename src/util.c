@@ -93,7 +93,7 @@ void error_invalid_nbits(void(free_resources)(void*), void* data) {
  * Concatenate s1 and s2 in a new string.
  */
 char *cat(char *s1, char *s2) {
-    char *s = (char *)malloc(strlen(s1) + strlen(s2));
+    char *s = (char *)malloc(strlen(s1) + strlen(s2) + 1);
     strcpy(s, s1);
     strcat(s, s2);
     return s;
@@ -114,7 +114,8 @@ char *rmsub(char s1[], char s2[]) {
     for (int i=s2_len-1; i>=0; i--) {
         if (s2[i] != s1[i+lendiff]) return NULL;
     }
-    char *sub = (char *)malloc(lendiff);
+    char *sub = (char *)malloc(lendiff + 1);
     sub = strncpy(sub, s1, lendiff);
+    sub[lendiff] = '\0';
     return sub;
 }
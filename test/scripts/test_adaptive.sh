@@ -0,0 +1,19 @@
+#!/usr/bin/env bash
+
+source "${BASH_SOURCE%/*}"/_setup_ah.sh
+FILE=$(mktemp)
+head -c 300000 /dev/urandom | od -An -tx1 | head -c 300000 > "${FILE}"
+echo "Testing compressing and decompressing with adaptive codes ..."
+${AH} -c --adaptive "${FILE}" | ${AH} -dc | cmp - "${FILE}" >/dev/null \
+    && echo -n "abc" | ${AH} --adaptive | ${AH} -d | egrep "^abc$" >/dev/null \
+    && test "$(printf "" | ${AH} --adaptive | ${AH} -d | wc -c)" -eq 0
+EXITCODE=$?
+if [ ${EXITCODE} -eq 0 ]; then
+    # The codes of the input available are written before its end
+    test "$( (echo "Another Huffman"; sleep 2) | ${AH} --adaptive | (timeout 1 cat | wc -c) )" -gt 4
+    EXITCODE=$?
+fi
+test ${EXITCODE} -eq 0 && echo "... Testing compressing and decompressing with adaptive codes done." \
+     || echo "... Testing compressing and decompressing with adaptive codes failed." >&2;
+rm "${FILE}"
+test ${EXITCODE} -eq 0
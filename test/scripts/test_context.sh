@@ -0,0 +1,14 @@
+#!/usr/bin/env bash
+
+source "${BASH_SOURCE%/*}"/_setup_ah.sh
+FILE=$(mktemp)
+for i in $(seq 40); do cat "${BASH_SOURCE%/*}"/../../COPYING; done > "${FILE}"
+echo "Testing compressing and decompressing with order-1 contexts ..."
+${AH} -c --context -T 2 "${FILE}" | ${AH} -dc -T 2 | cmp - "${FILE}" >/dev/null \
+    && echo -n "abc" | ${AH} --context | ${AH} -d | egrep "^abc$" >/dev/null \
+    && test $(${AH} -c --context "${FILE}" | wc -c) -lt $(${AH} -c "${FILE}" | wc -c)
+EXITCODE=$?
+test ${EXITCODE} -eq 0 && echo "... Testing compressing and decompressing with order-1 contexts done." \
+     || echo "... Testing compressing and decompressing with order-1 contexts failed." >&2;
+rm "${FILE}"
+test ${EXITCODE} -eq 0
@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+
+source "${BASH_SOURCE%/*}"/_setup_ah.sh
+FILE="${BASH_SOURCE%/*}/../../COPYING"
+EXPECTED=$(mktemp)
+OUTPUT=$(mktemp)
+echo "Testing counting kernels ..."
+${AH} -c --cpu=scalar "${FILE}" > "${EXPECTED}"
+EXITCODE=$?
+for KERNEL in sse2 avx2 avx512; do
+    ${AH} -c --cpu=${KERNEL} "${FILE}" > "${OUTPUT}" 2>/dev/null
+    KERNEL_EXITCODE=$?
+    if [ ${KERNEL_EXITCODE} -eq 9 ]; then
+        echo "... Kernel ${KERNEL} not supported by the CPU, skipped."
+    elif [ ${KERNEL_EXITCODE} -ne 0 ] || ! cmp "${OUTPUT}" "${EXPECTED}" >/dev/null; then
+        echo "... Testing counting kernel ${KERNEL} failed, different output than scalar." >&2;
+        EXITCODE=1
+    fi
+done
+test ${EXITCODE} -eq 0 && echo "... Testing counting kernels done." \
+     || echo "... Testing counting kernels failed." >&2;
+rm "${EXPECTED}" "${OUTPUT}"
+test ${EXITCODE} -eq 0
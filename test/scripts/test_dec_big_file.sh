@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+
+source "${BASH_SOURCE%/*}"/_setup_ah.sh
+# Any bit stream is a valid sequence of codes of a complete table, so the
+# files are the headers of the tables followed by 3 MB of pseudo-random bits
+FILE=$(mktemp)
+OUT=$(mktemp)
+CODES=$(mktemp)
+LC_ALL=C awk 'BEGIN { srand(1); for (i = 0; i < 3145728; i++) printf "%c", int(rand() * 256) }' > "${CODES}"
+# Format version 2 without blocks, 5000000 symbols of 3 to 5 bits, that
+# the speculative decoding syncs with the codes of the previous chunk
+V2_FILE='\x0f\xa1\x40\x00\x40\x4b\x4c\x00\x00\x00\x00\x00\x12\x00\x05\x00\x00\x04\x02'\
+'\x20\x65\x66\x6e\x0a\x32\x41\x48\x61\x68\x69\x6c\x6d\x6f\x72\x74\x75\x76'
+# Format version 2 without blocks, 8000000 symbols of 3 bits, that the
+# speculative decoding never syncs when a chunk starts between two codes
+V2_FIXED_FILE='\x0f\xa1\x40\x00\x00\x12\x7a\x00\x00\x00\x00\x00\x08\x00\x03\x00\x00\x61\x62\x63\x64\x65\x66\x67\x68'
+# Format version 1, 8000000 symbols of 3 bits
+V1_FIXED_FILE='\x0f\xa1\x20\x00\x00\x12\x7a\x00\x00\x00\x00\x00\x08\x00\x61\x03\x00\x62\x03\x01\x63\x03\x02'\
+'\x64\x03\x03\x65\x03\x04\x66\x03\x05\x67\x03\x06\x68\x03\x07'
+echo "Testing decompressing big streams without blocks with threads ..."
+EXITCODE=0
+for HEADER in "${V2_FILE}" "${V2_FIXED_FILE}" "${V1_FIXED_FILE}"; do
+    { printf "${HEADER}"; cat "${CODES}"; } > "${FILE}"
+    ${AH} -dc -T 1 "${FILE}" > "${OUT}"
+    EXITCODE=$?
+    for THREADS in 2 3 4; do
+        test ${EXITCODE} -eq 0 || break 2
+        # The codes split between the threads, with the same output than one thread
+        ${AH} -dc -T ${THREADS} "${FILE}" | cmp - "${OUT}" >/dev/null
+        EXITCODE=$?
+    done
+done
+test ${EXITCODE} -eq 0 && echo "... Testing decompressing big streams without blocks with threads done." \
+     || echo "... Testing decompressing big streams without blocks with threads failed with exit code ${EXITCODE}." >&2;
+rm "${FILE}" "${OUT}" "${CODES}"
+test ${EXITCODE} -eq 0
@@ -0,0 +1,18 @@
+#!/usr/bin/env bash
+
+source "${BASH_SOURCE%/*}"/_setup_ah.sh
+# "Another Huffman v1 file" compressed with the format version 1
+V1_FILE='\x0f\xa1\x20\x00\x17\x00\x00\x00\x00\x00\x00\x00\x11\x00\x76\x05\x07\x75\x05\x06\x74\x05\x01\x72'\
+'\x05\x00\x6f\x05\x03\x6d\x05\x02\x6c\x04\x0d\x69\x04\x0c\x68\x04\x0f\x61\x04\x0e\x48\x05\x11\x41'\
+'\x05\x10\x31\x04\x09\x6e\x04\x02\x65\x03\x05\x66\x03\x03\x20\x03\x02\x81\x0c\x3f\x40\xa2\x66\xc5\xc4\x8f\x29\xe6\xd0'
+echo "Testing decompressing stream with format version 1 ..."
+printf "${V1_FILE}" | ${AH} -d | egrep "^Another Huffman v1 file$" >/dev/null
+EXITCODE=$?
+if [ ${EXITCODE} -eq 0 ]; then
+    # The codes split between the threads
+    printf "${V1_FILE}" | ${AH} -d -T 3 | egrep "^Another Huffman v1 file$" >/dev/null
+    EXITCODE=$?
+fi
+test ${EXITCODE} -eq 0 && echo "... Testing decompressing stream with format version 1 done." \
+     || echo "... Testing decompressing stream with format version 1 failed with exit code ${EXITCODE}." >&2;
+test ${EXITCODE} -eq 0
@@ -0,0 +1,17 @@
+#!/usr/bin/env bash
+
+source "${BASH_SOURCE%/*}"/_setup_ah.sh
+# "Another Huffman v2 file" compressed with the format version 2 in one stream (without blocks)
+V2_FILE='\x0f\xa1\x40\x00\x18\x00\x00\x00\x00\x00\x00\x00\x12\x00\x05\x00\x00\x04\x02\x20\x65\x66\x6e\x0a'\
+'\x32\x41\x48\x61\x68\x69\x6c\x6d\x6f\x72\x74\x75\x76\xa3\xdf\x6e\x78\x2b\xe4\xb5\x66\x3f\x21\x63\x26\x00'
+echo "Testing decompressing stream with format version 2 without blocks ..."
+printf "${V2_FILE}" | ${AH} -d | egrep "^Another Huffman v2 file$" >/dev/null
+EXITCODE=$?
+if [ ${EXITCODE} -eq 0 ]; then
+    # The codes split between the threads
+    printf "${V2_FILE}" | ${AH} -d -T 3 | egrep "^Another Huffman v2 file$" >/dev/null
+    EXITCODE=$?
+fi
+test ${EXITCODE} -eq 0 && echo "... Testing decompressing stream with format version 2 without blocks done." \
+     || echo "... Testing decompressing stream with format version 2 without blocks failed with exit code ${EXITCODE}." >&2;
+test ${EXITCODE} -eq 0
@@ -0,0 +1,14 @@
+#!/usr/bin/env bash
+
+source "${BASH_SOURCE%/*}"/_setup_ah.sh
+FILE=$(mktemp)
+head -c 2500000 /dev/urandom | od -An -tx2 -w4 | head -c 2500000 > "${FILE}"
+echo "Testing compressing and decompressing stream of several blocks ..."
+# The stream is compressed block by block, with the same output than the file
+cat "${FILE}" | ${AH} -c | cmp - <(${AH} -c "${FILE}") >/dev/null \
+    && cat "${FILE}" | ${AH} -c -T 2 | ${AH} -d | cmp - "${FILE}" >/dev/null
+EXITCODE=$?
+test ${EXITCODE} -eq 0 && echo "... Testing compressing and decompressing stream of several blocks done." \
+     || echo "... Testing compressing and decompressing stream of several blocks failed." >&2;
+rm "${FILE}"
+test ${EXITCODE} -eq 0
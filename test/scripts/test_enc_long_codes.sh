@@ -0,0 +1,19 @@
+#!/usr/bin/env bash
+
+source "${BASH_SOURCE%/*}"/_setup_ah.sh
+FILE=$(mktemp)
+# Fibonacci frequencies produce the longest Huffman codes
+A=1; B=1
+for SYMBOL in a b c d e f g h i j k l m n o p q r s t u v w x; do
+    yes ${SYMBOL} | head -n ${A} | tr -d '\n' >> "${FILE}"
+    C=$((A + B)); A=${B}; B=${C}
+done
+echo "Testing compressing and decompressing symbols with long codes ..."
+# Codes limited to the default max length, and up to the max length supported
+${AH} -c "${FILE}" | ${AH} -dc | cmp - "${FILE}" >/dev/null \
+    && ${AH} -c --max-code-len=56 "${FILE}" | ${AH} -dc | cmp - "${FILE}" >/dev/null
+EXITCODE=$?
+test ${EXITCODE} -eq 0 && echo "... Testing compressing and decompressing symbols with long codes done." \
+     || echo "... Testing compressing and decompressing symbols with long codes failed." >&2;
+rm "${FILE}"
+test ${EXITCODE} -eq 0
@@ -0,0 +1,16 @@
+#!/usr/bin/env bash
+
+source "${BASH_SOURCE%/*}"/_setup_ah.sh
+FILE=$(mktemp)
+for i in $(seq 40); do cat "${BASH_SOURCE%/*}"/../../COPYING; done > "${FILE}"
+head -c 300000 /dev/urandom >> "${FILE}"
+echo "Testing compressing and decompressing with tables of samples ..."
+${AH} -c --fast "${FILE}" | ${AH} -dc | cmp - "${FILE}" >/dev/null \
+    && ${AH} -c --fast -T 3 --interleave "${FILE}" | ${AH} -dc | cmp - "${FILE}" >/dev/null \
+    && cat "${FILE}" | ${AH} --fast | ${AH} -d | cmp - "${FILE}" >/dev/null \
+    && echo -n "abc" | ${AH} --fast | ${AH} -d | egrep "^abc$" >/dev/null
+EXITCODE=$?
+test ${EXITCODE} -eq 0 && echo "... Testing compressing and decompressing with tables of samples done." \
+     || echo "... Testing compressing and decompressing with tables of samples failed." >&2;
+rm "${FILE}"
+test ${EXITCODE} -eq 0
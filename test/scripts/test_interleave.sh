@@ -0,0 +1,13 @@
+#!/usr/bin/env bash
+
+source "${BASH_SOURCE%/*}"/_setup_ah.sh
+FILE=$(mktemp)
+head -c 1500000 /dev/urandom | od -An -tx1 | head -c 1500000 > "${FILE}"
+echo "Testing compressing and decompressing with the codes in 4 streams ..."
+${AH} -c --interleave "${FILE}" | ${AH} -dc | cmp - "${FILE}" >/dev/null \
+    && echo -n "abc" | ${AH} -c --interleave | ${AH} -d | egrep "^abc$" >/dev/null
+EXITCODE=$?
+test ${EXITCODE} -eq 0 && echo "... Testing compressing and decompressing with the codes in 4 streams done." \
+     || echo "... Testing compressing and decompressing with the codes in 4 streams failed." >&2;
+rm "${FILE}"
+test ${EXITCODE} -eq 0
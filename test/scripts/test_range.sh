@@ -0,0 +1,24 @@
+#!/usr/bin/env bash
+
+source "${BASH_SOURCE%/*}"/_setup_ah.sh
+FILE=$(mktemp)
+COMPRESSED=$(mktemp)
+head -c 2500000 /dev/urandom | od -An -tx1 | head -c 2500000 > "${FILE}"
+echo "Testing decompressing a range with the seek index ..."
+${AH} -c --index "${FILE}" > "${COMPRESSED}" \
+    && test "$(${AH} -dc --range=2000000:100000 "${COMPRESSED}" | cksum)" \
+          = "$(tail -c +2000001 "${FILE}" | head -c 100000 | cksum)" \
+    && test "$(${AH} -dc --range=1048000:1000 "${COMPRESSED}" | cksum)" \
+          = "$(tail -c +1048001 "${FILE}" | head -c 1000 | cksum)" \
+    && ${AH} -dc "${COMPRESSED}" | cmp - "${FILE}" >/dev/null
+EXITCODE=$?
+if [ ${EXITCODE} -eq 0 ]; then
+    # Without index, the blocks before the range are skipped
+    test "$(${AH} -c "${FILE}" | ${AH} -d --range=1500000:10 | cksum)" \
+       = "$(tail -c +1500001 "${FILE}" | head -c 10 | cksum)"
+    EXITCODE=$?
+fi
+test ${EXITCODE} -eq 0 && echo "... Testing decompressing a range with the seek index done." \
+     || echo "... Testing decompressing a range with the seek index failed." >&2;
+rm "${FILE}" "${COMPRESSED}"
+test ${EXITCODE} -eq 0
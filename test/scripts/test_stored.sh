@@ -0,0 +1,18 @@
+#!/usr/bin/env bash
+
+source "${BASH_SOURCE%/*}"/_setup_ah.sh
+FILE=$(mktemp)
+RANDOM_FILE=$(mktemp)
+head -c 2500000 /dev/urandom > "${RANDOM_FILE}"
+cat "${RANDOM_FILE}" "${BASH_SOURCE%/*}"/../../COPYING "${RANDOM_FILE}" > "${FILE}"
+echo "Testing compressing and decompressing blocks stored without encoding ..."
+${AH} -c "${FILE}" | ${AH} -dc | cmp - "${FILE}" >/dev/null \
+    && ${AH} -c -T 3 --interleave "${FILE}" | ${AH} -dc -T 2 | cmp - "${FILE}" >/dev/null \
+    && ${AH} -c --context "${FILE}" | ${AH} -dc | cmp - "${FILE}" >/dev/null \
+    && cat "${FILE}" | ${AH} | ${AH} -d | cmp - "${FILE}" >/dev/null \
+    && test $(${AH} -c "${RANDOM_FILE}" | wc -c) -le $(( $(wc -c < "${RANDOM_FILE}") + 64 ))
+EXITCODE=$?
+test ${EXITCODE} -eq 0 && echo "... Testing compressing and decompressing blocks stored without encoding done." \
+     || echo "... Testing compressing and decompressing blocks stored without encoding failed." >&2;
+rm "${FILE}" "${RANDOM_FILE}"
+test ${EXITCODE} -eq 0
@@ -0,0 +1,16 @@
+#!/usr/bin/env bash
+
+source "${BASH_SOURCE%/*}"/_setup_ah.sh
+FILE=$(mktemp)
+head -c 3000000 /dev/urandom > "${FILE}"
+echo "Testing compressing and decompressing with threads ..."
+test "$(${AH} -c "${FILE}" | cksum)" = "$(${AH} -c -T 3 "${FILE}" | cksum)"
+EXITCODE=$?
+if [ ${EXITCODE} -eq 0 ]; then
+    ${AH} -c -T 2 "${FILE}" | ${AH} -dc -T 3 | cmp - "${FILE}" >/dev/null
+    EXITCODE=$?
+fi
+test ${EXITCODE} -eq 0 && echo "... Testing compressing and decompressing with threads done." \
+     || echo "... Testing compressing and decompressing with threads failed." >&2;
+rm "${FILE}"
+test ${EXITCODE} -eq 0
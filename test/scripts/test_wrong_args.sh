@@ -4,6 +4,13 @@ source "${BASH_SOURCE%/*}"/_setup_ah.sh
 echo "Testing wrong arguments ..."
 ${AH} -Nop >/dev/null 2>/dev/null
 EXITCODE=$?
+# Numeric options with invalid values or trailing garbage, and incompatible options
+for ARGS in "-T abc" "-T 2x" "-T 0" "--max-code-len=12x" "--max-code-len=" \
+            "--adaptive --index" "--adaptive --interleave" "--adaptive --context"; do
+    test ${EXITCODE} -eq 3 || break
+    echo -n "abc" | ${AH} -c ${ARGS} >/dev/null 2>/dev/null
+    EXITCODE=$?
+done
 test ${EXITCODE} -eq 3 && echo "... Testing wrong arguments done." \
      || echo "... Testing wrong arguments failed with exit code ${EXITCODE}." >&2;
 test ${EXITCODE} -eq 3
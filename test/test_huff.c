@@ -65,3 +65,32 @@ CHEAT_TEST(expected_build_huff_4_ok,
     freqlist_fprintf_tree(stderr, VERBOSE_TREE, data->freql);
     cheat_assert(  freqlist_check_tree(data->freql, expected_ah_4, ARRAY_SIZE(expected_ah_4))  );
 )
+
+/****************************
+ *  DATA SET 4: canonical codes
+ ****************************/
+CHEAT_DECLARE(
+    unsigned int expected_canonical_4[][3] = { {'s',6,63}, {'j',6,62}, {'e',5,30}, {'t',4,14},
+                                               {'l',4,13}, {'c',4,12}, {' ',2,2}, {'a',1,0} };
+)
+CHEAT_TEST(expected_canonical_4_ok,
+    data=count_buff((unsigned char*)buff_4, strlen(buff_4), FALSE);
+    freqlist_build_huff(data->freql);
+    freqlist_canonical(data->freql);
+    cheat_assert(  freqlist_check_tree(data->freql, expected_canonical_4, ARRAY_SIZE(expected_canonical_4))  );
+)
+
+/****************************
+ *  DATA SET 4: codes limited to 4 bits
+ ****************************/
+CHEAT_DECLARE(
+    unsigned int expected_limited_4[][3] = { {'s',4,14}, {'j',4,12}, {'e',4,11}, {'t',4,15},
+                                             {'l',4,13}, {'c',4,10}, {' ',3,4}, {'a',1,0} };
+)
+CHEAT_TEST(expected_limited_4_ok,
+    data=count_buff((unsigned char*)buff_4, strlen(buff_4), FALSE);
+    freqlist_build_huff(data->freql);
+    cheat_assert(  freqlist_limit_nbits(data->freql, 4) == 4  );
+    freqlist_canonical(data->freql);
+    cheat_assert(  freqlist_check_tree(data->freql, expected_limited_4, ARRAY_SIZE(expected_limited_4))  );
+)
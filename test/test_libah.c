@@ -0,0 +1,381 @@
+/* test_libah.c
+
+   Copyright (C) 2021-2025 Mariano Ruiz <mrsarm@gmail.com>
+   This file is part of the "Another Huffman" encoder project.
+
+   This project is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the "Another Huffman" encoder project; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cheat.h>
+#include <ah.h>
+#include <block.h>
+#include <libah.h>
+#include "util_t.h"
+
+
+CHEAT_DECLARE(
+    /* Compress and decompress len bytes of buff with ctx, and
+       check the output is the same */
+    int round_trip(ah_ctx *ctx, const unsigned char *buff, size_t len) {
+        const unsigned char *enc, *dec;
+        size_t len_enc, len_dec;
+        if (ah_compress_buffer(ctx, buff, len, &enc, &len_enc)) return 0;
+        unsigned char *copy = (unsigned char *) malloc(len_enc);
+        memcpy(copy, enc, len_enc);     // enc is overwritten by the next call
+        int r = ah_decompress_buffer(ctx, copy, len_enc, &dec, &len_dec);
+        free(copy);
+        return !r && len_dec == len && (len == 0 || memcmp(dec, buff, len) == 0);
+    }
+
+    /* Fill buff with len bytes of text-like data */
+    void fill_text(unsigned char *buff, size_t len) {
+        const char *words[] = { "another ", "huffman ", "encoder ", "block ", "code\n" };
+        unsigned int seed = 1;
+        for (size_t i = 0; i < len; ) {
+            seed = seed * 1103515245 + 12345;
+            const char *w = words[(seed >> 16) % 5];
+            for (; *w && i < len; w++) buff[i++] = *w;
+        }
+    }
+
+    /* Compress len bytes of buff with a stream, passing the input
+       in chunks of chunk_in bytes and the output in chunks of chunk_out
+       bytes, with AH_FLUSH after flush_at bytes (if not 0). Return the
+       compressed data in a new buffer, with its length in len_enc */
+    unsigned char *stream_encode(const unsigned char *buff, size_t len, size_t chunk_in,
+                                 size_t chunk_out, size_t flush_at, size_t *len_enc) {
+        ah_stream *s = ah_stream_create(FALSE);
+        unsigned char *enc = (unsigned char *) malloc(2 * len + chunk_out + 100);
+        size_t pos = 0, used, n;
+        int r = OK;
+        *len_enc = 0;
+        while (r == OK) {
+            size_t end = pos + chunk_in < len ? pos + chunk_in : len;
+            int flush = end == len ? AH_FINISH : pos < flush_at && flush_at <= end ? AH_FLUSH : AH_NO_FLUSH;
+            if (flush == AH_FLUSH) end = flush_at;
+            r = ah_stream_encode(s, buff + pos, end - pos, &used, enc + *len_enc, chunk_out, &n, flush);
+            pos += used;
+            *len_enc += n;
+        }
+        ah_stream_free(s);
+        if (r != AH_STREAM_END) {
+            free(enc);
+            return NULL;
+        }
+        return enc;
+    }
+
+    /* Decompress enc with a stream, in chunks of chunk_in and chunk_out
+       bytes, and check the output is the len bytes of buff */
+    int stream_decode_check(const unsigned char *enc, size_t len_enc, size_t chunk_in,
+                            size_t chunk_out, const unsigned char *buff, size_t len) {
+        ah_stream *s = ah_stream_create(TRUE);
+        unsigned char *dec = (unsigned char *) malloc(len + chunk_out);
+        size_t pos = 0, len_dec = 0, used, n;
+        int r = OK;
+        while (r == OK) {
+            size_t end = pos + chunk_in < len_enc ? pos + chunk_in : len_enc;
+            r = ah_stream_decode(s, enc + pos, end - pos, &used, dec + len_dec, chunk_out, &n);
+            pos += used;
+            len_dec += n;
+            if (r == OK && used == 0 && n == 0) break;      // Truncated
+        }
+        int ok = r == AH_STREAM_END && len_dec == len && memcmp(dec, buff, len) == 0;
+        ah_stream_free(s);
+        free(dec);
+        return ok;
+    }
+
+    /* Thread body, round trips with its own context */
+    void *round_trips(void *arg) {
+        size_t len = BLOCK_SIZE + 999;
+        unsigned char *buff = (unsigned char *) malloc(len);
+        fill_text(buff, len);
+        ah_ctx *ctx = ah_ctx_create();
+        ah_ctx_set_option(ctx, AH_OPT_INTERLEAVE, *(int *) arg > 1);
+        intptr_t ok = TRUE;
+        for (int i = 0; i < 4; i++) {
+            ok = ok && round_trip(ctx, buff, len - i * 100);
+        }
+        ah_ctx_free(ctx);
+        free(buff);
+        return (void *) ok;
+    }
+)
+
+
+CHEAT_TEST(compress_buffer_round_trip_ok,
+    const unsigned char buff[] = "AAAAABBBCCCCCCCCDDDDDDDDDDDDDDEFFFFF";
+    ah_ctx *ctx = ah_ctx_create();
+    cheat_assert( ctx != NULL );
+    cheat_assert( round_trip(ctx, buff, sizeof(buff) - 1) );
+    ah_ctx_free(ctx);
+)
+
+CHEAT_TEST(compress_buffer_empty_ok,
+    ah_ctx *ctx = ah_ctx_create();
+    const unsigned char *enc;
+    size_t len_enc;
+    cheat_assert( ah_compress_buffer(ctx, (const unsigned char *) "", 0, &enc, &len_enc) == 0 );
+    cheat_assert( len_enc == 12 );      // Header, block size and end mark
+    cheat_assert( round_trip(ctx, (const unsigned char *) "", 0) );
+    ah_ctx_free(ctx);
+)
+
+CHEAT_TEST(compress_buffer_one_byte_ok,
+    ah_ctx *ctx = ah_ctx_create();
+    cheat_assert( round_trip(ctx, (const unsigned char *) "x", 1) );
+    ah_ctx_free(ctx);
+)
+
+CHEAT_TEST(compress_buffer_many_blocks_reusing_ctx_ok,
+    size_t len = 3 * BLOCK_SIZE + 12345;
+    unsigned char *buff = (unsigned char *) malloc(len);
+    fill_text(buff, len);
+    ah_ctx *ctx = ah_ctx_create();
+    cheat_assert( round_trip(ctx, buff, len) );
+    cheat_assert( ah_ctx_set_option(ctx, AH_OPT_THREADS, 3) == OK );
+    cheat_assert( round_trip(ctx, buff, len) );
+    cheat_assert( ah_ctx_set_option(ctx, AH_OPT_INTERLEAVE, TRUE) == OK );
+    cheat_assert( round_trip(ctx, buff, len) );
+    cheat_assert( ah_ctx_set_option(ctx, AH_OPT_CONTEXT, TRUE) == OK );
+    cheat_assert( round_trip(ctx, buff, len) );
+    cheat_assert( ah_ctx_set_option(ctx, AH_OPT_THREADS, 1) == OK );
+    cheat_assert( round_trip(ctx, buff, 1000) );
+    ah_ctx_free(ctx);
+    free(buff);
+)
+
+CHEAT_TEST(compress_buffer_contexts_changing_between_blocks_ok,
+    size_t len = 3 * BLOCK_SIZE;
+    unsigned char *buff = (unsigned char *) malloc(len);
+    fill_text(buff, len);
+    for (size_t i = BLOCK_SIZE; i < 2 * BLOCK_SIZE; i++) {
+        if (buff[i] >= 'a' && buff[i] <= 'z') buff[i] -= 'a' - 'A';
+    }
+    buff[2 * BLOCK_SIZE + 10] = 'x';    // Almost the same tables than the first block
+    ah_ctx *ctx = ah_ctx_create();
+    cheat_assert( ah_ctx_set_option(ctx, AH_OPT_CONTEXT, TRUE) == OK );
+    cheat_assert( round_trip(ctx, buff, len) );
+    cheat_assert( round_trip(ctx, buff + BLOCK_SIZE, len - BLOCK_SIZE) );
+    ah_ctx_free(ctx);
+    free(buff);
+)
+
+CHEAT_TEST(compress_buffer_fast_symbols_not_sampled_ok,
+    size_t len = 2 * BLOCK_SIZE + 7;
+    unsigned char *buff = (unsigned char *) malloc(len);
+    fill_text(buff, len);
+    buff[5000] = 0xFF;                  // Outside of the samples of the block
+    buff[BLOCK_SIZE + 70000] = 0x01;
+    ah_ctx *ctx = ah_ctx_create();
+    cheat_assert( ah_ctx_set_option(ctx, AH_OPT_FAST, TRUE) == OK );
+    const unsigned char *enc;
+    size_t len_enc;
+    cheat_assert( ah_compress_buffer(ctx, buff, len, &enc, &len_enc) == 0 );
+    cheat_assert( len_enc < len * 6 / 10 );
+    cheat_assert( round_trip(ctx, buff, len) );
+    cheat_assert( ah_ctx_set_option(ctx, AH_OPT_INTERLEAVE, TRUE) == OK );
+    cheat_assert( ah_ctx_set_option(ctx, AH_OPT_THREADS, 2) == OK );
+    cheat_assert( round_trip(ctx, buff, len) );
+    ah_ctx_free(ctx);
+    free(buff);
+)
+
+CHEAT_TEST(compress_buffer_same_output_with_threads_ok,
+    size_t len = 2 * BLOCK_SIZE + 7;
+    unsigned char *buff = (unsigned char *) malloc(len);
+    fill_text(buff, len);
+    ah_ctx *ctx1 = ah_ctx_create(), *ctx4 = ah_ctx_create();
+    cheat_assert( ah_ctx_set_option(ctx4, AH_OPT_THREADS, 4) == OK );
+    const unsigned char *enc1, *enc4;
+    size_t len1, len4;
+    cheat_assert( ah_compress_buffer(ctx1, buff, len, &enc1, &len1) == 0 );
+    cheat_assert( ah_compress_buffer(ctx4, buff, len, &enc4, &len4) == 0 );
+    cheat_assert( len1 == len4 && memcmp(enc1, enc4, len1) == 0 );
+    cheat_assert( len1 < len );
+    ah_ctx_free(ctx1);
+    ah_ctx_free(ctx4);
+    free(buff);
+)
+
+CHEAT_TEST(decompress_buffer_invalid_input_error,
+    ah_ctx *ctx = ah_ctx_create();
+    const unsigned char *enc, *dec;
+    size_t len_enc, len_dec;
+    cheat_assert( ah_decompress_buffer(ctx, (const unsigned char *) "nothing", 7,
+                                       &dec, &len_dec) == INVALID_FILE_IN );
+    cheat_assert( ah_compress_buffer(ctx, (const unsigned char *) "truncated", 9,
+                                     &enc, &len_enc) == 0 );
+    cheat_assert( ah_decompress_buffer(ctx, enc, len_enc - 5,
+                                       &dec, &len_dec) == INVALID_FILE_IN );
+    ah_ctx_free(ctx);
+)
+
+CHEAT_TEST(decompress_buffer_incomplete_table_error,
+    // Block of 400 bytes in 4 streams, with the codes 0, 10 and 110 of 'a', 'b'
+    // and 'c', so 111 is not a code, and all the streams full of 1s
+    const unsigned char head[] = "\x0f\xa1\x40\x23\x00\x00\x10\x00\x90\x01\x00\x00"
+                                 "\x78\x00\x00\x00\x03\x00\x03\x01\x01" "abc"
+                                 "\x19\x00\x00\x00\x19\x00\x00\x00\x19\x00\x00\x00";
+    unsigned char in[sizeof(head) - 1 + 100 + COUNT_SIZE];
+    memcpy(in, head, sizeof(head) - 1);
+    memset(in + sizeof(head) - 1, 0xff, 100);
+    memset(in + sizeof(head) - 1 + 100, 0, COUNT_SIZE);
+    ah_ctx *ctx = ah_ctx_create();
+    const unsigned char *dec;
+    size_t len_dec;
+    cheat_assert( ah_decompress_buffer(ctx, in, sizeof(in), &dec, &len_dec) == INVALID_FILE_IN );
+    ah_ctx_free(ctx);
+)
+
+CHEAT_TEST(decompress_buffer_block_too_long_error,
+    // Block of 1 byte with a valid table of one symbol, but followed
+    // by more encoded data than any valid block of 1 byte
+    size_t len_enc = block_max_encoded(1) + 1, len = 16 + len_enc + COUNT_SIZE;
+    unsigned char *in = (unsigned char *) calloc(len, 1);
+    memcpy(in, "\x0f\xa1\x40\x21\x00\x00\x10\x00\x01\x00\x00\x00", 12);
+    unsigned int n = (unsigned int) len_enc;
+    memcpy(in + 12, &n, COUNT_SIZE);
+    memcpy(in + 16, "\x01\x00\x00" "a", 4);
+    ah_ctx *ctx = ah_ctx_create();
+    const unsigned char *dec;
+    size_t len_dec;
+    cheat_assert( ah_decompress_buffer(ctx, in, len, &dec, &len_dec) == INVALID_FILE_IN );
+    ah_ctx_free(ctx);
+    free(in);
+)
+
+CHEAT_TEST(decompress_buffer_error_in_ctx,
+    ah_ctx *ctx = ah_ctx_create();
+    const unsigned char *dec;
+    size_t len_dec;
+    cheat_assert( ah_decompress_buffer(ctx, (const unsigned char *) "\x0f\xa1\x7f", 3,
+                                       &dec, &len_dec) == INVALID_FILE_IN );
+    cheat_assert( ah_ctx_error(ctx) == INVALID_FILE_IN );
+    cheat_assert( strcmp(ah_strerror(ah_ctx_error(ctx)), "The input is not valid") == 0 );
+    cheat_assert( round_trip(ctx, (const unsigned char *) "ok", 2) );
+    cheat_assert( ah_ctx_error(ctx) == OK );
+    ah_ctx_free(ctx);
+)
+
+CHEAT_TEST(set_option_invalid_error,
+    ah_ctx *ctx = ah_ctx_create();
+    cheat_assert( ah_ctx_set_option(ctx, AH_OPT_THREADS, 0) == AH_ERROR_PARAM );
+    cheat_assert( ah_ctx_set_option(ctx, AH_OPT_MAX_CODE_LEN, 99) == AH_ERROR_PARAM );
+    cheat_assert( ah_ctx_set_option(ctx, 99, 1) == AH_ERROR_PARAM );
+    cheat_assert( ah_ctx_set_option(ctx, AH_OPT_MAX_CODE_LEN, 10) == AH_OK );
+    cheat_assert( ah_ctx_set_option(ctx, AH_OPT_MAX_BLOCK_SIZE, 4096) == AH_ERROR_PARAM );
+    ah_ctx_free(ctx);
+    ah_stream *s = ah_stream_create(FALSE);
+    cheat_assert( ah_stream_set_option(s, AH_OPT_THREADS, 2) == AH_ERROR_PARAM );
+    cheat_assert( ah_stream_set_option(s, AH_OPT_MAX_BLOCK_SIZE, 0) == AH_ERROR_PARAM );
+    cheat_assert( ah_stream_set_option(s, AH_OPT_CONTEXT, 1) == AH_OK );
+    ah_stream_free(s);
+)
+
+CHEAT_TEST(compress_buffer_contexts_in_threads_ok,
+    pthread_t threads[8];
+    int streams[8];
+    for (int i = 0; i < 8; i++) {
+        streams[i] = i % 2 ? CODEC_STREAMS : 1;
+        cheat_assert( pthread_create(&threads[i], NULL, round_trips, &streams[i]) == 0 );
+    }
+    for (int i = 0; i < 8; i++) {
+        void *ok;
+        pthread_join(threads[i], &ok);
+        cheat_assert( ok );
+    }
+)
+
+CHEAT_TEST(stream_encode_same_as_buffer_ok,
+    size_t len = 2 * BLOCK_SIZE + 4321, len_enc, len_buff;
+    unsigned char *buff = (unsigned char *) malloc(len);
+    fill_text(buff, len);
+    const size_t chunks[][2] = { {1, 1}, {7, 1000}, {BLOCK_SIZE + 1, 64}, {3 * BLOCK_SIZE, 3 * BLOCK_SIZE} };
+    ah_ctx *ctx = ah_ctx_create();
+    const unsigned char *enc_buff;
+    cheat_assert( ah_compress_buffer(ctx, buff, len, &enc_buff, &len_buff) == 0 );
+    for (size_t i = 0; i < ARRAY_SIZE(chunks); i++) {
+        // The chunk of 1 byte is too slow with the whole input
+        size_t l = chunks[i][0] == 1 ? 5000 : len;
+        unsigned char *enc = stream_encode(buff, l, chunks[i][0], chunks[i][1], 0, &len_enc);
+        cheat_assert( enc != NULL );
+        if (l == len) {
+            cheat_assert( len_enc == len_buff && memcmp(enc, enc_buff, len_enc) == 0 );
+        }
+        cheat_assert( stream_decode_check(enc, len_enc, chunks[i][1], chunks[i][0], buff, l) );
+        free(enc);
+    }
+    ah_ctx_free(ctx);
+    free(buff);
+)
+
+CHEAT_TEST(stream_encode_flush_and_empty_ok,
+    size_t len = BLOCK_SIZE + 10, len_enc;
+    unsigned char *buff = (unsigned char *) malloc(len);
+    fill_text(buff, len);
+    unsigned char *enc = stream_encode(buff, len, 1000, 333, 12345, &len_enc);
+    cheat_assert( enc != NULL );
+    cheat_assert( stream_decode_check(enc, len_enc, 4096, 4096, buff, len) );
+    free(enc);
+    enc = stream_encode(buff, 0, 10, 10, 0, &len_enc);
+    cheat_assert( enc != NULL && len_enc == 12 );
+    cheat_assert( stream_decode_check(enc, len_enc, 1, 1, buff, 0) );
+    free(enc);
+    free(buff);
+)
+
+CHEAT_TEST(stream_decode_invalid_input_error,
+    ah_stream *s = ah_stream_create(TRUE);
+    unsigned char out[16];
+    size_t used, n;
+    cheat_assert( ah_stream_decode(s, (const unsigned char *) "\x0f\xa1", 2, &used, out, 16, &n) == OK );
+    cheat_assert( used == 2 && n == 0 );
+    cheat_assert( ah_stream_decode(s, (const unsigned char *) "\x03\x08", 2, &used, out, 16, &n) == INVALID_FILE_IN );
+    cheat_assert( ah_stream_error(s) == INVALID_FILE_IN );
+    ah_stream_free(s);
+)
+
+CHEAT_TEST(stream_decode_block_too_long_error,
+    ah_stream *s = ah_stream_create(TRUE);
+    // Block of 10 bytes, with 4 GB of encoded data
+    const unsigned char in[] = "\x0f\xa1\x40\x21\x00\x00\x10\x00\x0a\x00\x00\x00\xff\xff\xff\xff";
+    unsigned char out[16];
+    size_t used, n;
+    cheat_assert( ah_stream_decode(s, in, sizeof(in) - 1, &used, out, 16, &n) == INVALID_FILE_IN );
+    cheat_assert( ah_stream_error(s) == INVALID_FILE_IN );
+    ah_stream_free(s);
+)
+
+CHEAT_TEST(stream_decode_max_block_size_error,
+    // Blocks of 16 MB, with a stored block of 2 bytes
+    const unsigned char in[] = "\x0f\xa1\x40\x21\x00\x00\x00\x01"
+                               "\x02\x00\x00\x00\x02\x00\x00\x00" "ok" "\x00\x00\x00\x00";
+    unsigned char out[16];
+    size_t used, n;
+    ah_stream *s = ah_stream_create(TRUE);
+    cheat_assert( ah_stream_decode(s, in, sizeof(in) - 1, &used, out, 16, &n) == AH_INVALID_FILE_IN );
+    ah_stream_free(s);
+    s = ah_stream_create(TRUE);
+    cheat_assert( ah_stream_set_option(s, AH_OPT_MAX_BLOCK_SIZE, 16 * 1024 * 1024) == AH_OK );
+    cheat_assert( ah_stream_decode(s, in, sizeof(in) - 1, &used, out, 16, &n) == AH_STREAM_END );
+    cheat_assert( n == 2 && memcmp(out, "ok", 2) == 0 );
+    ah_stream_free(s);
+)
@@ -18,11 +18,28 @@
    <http://www.gnu.org/licenses/>.  */
 
 
+#include <pthread.h>
+#include <stdint.h>
 #include <string.h>
 #include <cheat.h>
+#include <ring.h>
 #include <util.h>
 
 
+CHEAT_DECLARE(
+    #define RING_ITEMS  100000
+
+    /* Thread body, push the numbers from 1 to RING_ITEMS, and NULL */
+    void *push_numbers(void *arg) {
+        for (intptr_t i = 1; i <= RING_ITEMS; i++) {
+            ring_push((ring *) arg, (void *) i);
+        }
+        ring_push((ring *) arg, NULL);
+        return NULL;
+    }
+)
+
+
 /***************
  *  Test strings
  ***************/
@@ -38,3 +55,29 @@ CHEAT_TEST(rmsub_expected_not_substring,
 CHEAT_TEST(rmsub_expected_string_substring_ok_with_more_ext,
     cheat_assert( strcmp(rmsub("file.txt.av", ".av"), "file.txt") == 0 );
 )
+
+
+/*************
+ *  Test rings
+ *************/
+
+CHEAT_TEST(ring_size_power_of_2,
+    ring q;
+    cheat_assert( ring_init(&q, 5) == 0 );
+    cheat_assert( q.size == 8 );
+    ring_free(&q);
+)
+
+CHEAT_TEST(ring_items_in_order_between_threads,
+    ring q;
+    pthread_t producer;
+    cheat_assert( ring_init(&q, 4) == 0 );
+    cheat_assert( pthread_create(&producer, NULL, push_numbers, &q) == 0 );
+    intptr_t expected = 1, i;
+    while ((i = (intptr_t) ring_pop(&q)) && i == expected) {
+        expected++;
+    }
+    pthread_join(producer, NULL);
+    cheat_assert( i == 0 && expected == RING_ITEMS + 1 );
+    ring_free(&q);
+)